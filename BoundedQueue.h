@@ -0,0 +1,100 @@
+/* Bounded lock-free queue, for handing work from one thread to others.
+   Written by Andrew Shallue, following Dmitry Vyukov's bounded MPMC queue.
+
+   The queue is a ring of cells, each with a sequence number.  A cell at position pos is free
+   for a push when its sequence equals pos, and holds a value ready to pop when its sequence is pos + 1.
+   Pushers and poppers claim positions with a compare and swap on their own counter, so neither side
+   ever takes a lock.  Any number of threads may push and pop.
+
+   push and pop return false rather than wait when the queue is full or empty; callers decide how to wait.
+   Capacity is rounded up to a power of 2.
+*/
+
+#ifndef BOUNDEDQUEUE_H
+#define BOUNDEDQUEUE_H
+
+#include <atomic>
+#include <vector>
+#include <cstddef>
+
+using namespace std;
+
+template <class T>
+class BoundedQueue
+{
+private:
+  struct Cell
+  {
+    atomic<size_t> seq;
+    T data;
+  };
+
+  vector<Cell> cells;
+  size_t mask;
+
+  // pushers and poppers on separate cache lines
+  alignas(64) atomic<size_t> push_pos;
+  alignas(64) atomic<size_t> pop_pos;
+
+public:
+  BoundedQueue(size_t capacity)
+  {
+    size_t size = 1;
+    while(size < capacity) size *= 2;
+    cells = vector<Cell>(size);
+    mask = size - 1;
+    for(size_t i = 0; i < size; ++i) cells[i].seq.store(i, memory_order_relaxed);
+    push_pos.store(0, memory_order_relaxed);
+    pop_pos.store(0, memory_order_relaxed);
+  }
+
+  // not copyable, the atomics are shared state
+  BoundedQueue(const BoundedQueue& other) = delete;
+  BoundedQueue& operator=(const BoundedQueue& other) = delete;
+
+  bool push(const T& value)
+  {
+    size_t pos = push_pos.load(memory_order_relaxed);
+    while(true){
+      Cell& cell = cells[pos & mask];
+      size_t seq = cell.seq.load(memory_order_acquire);
+      long dif = (long)seq - (long)pos;
+      if(dif == 0){
+        if(push_pos.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)){
+          cell.data = value;
+          cell.seq.store(pos + 1, memory_order_release);
+          return true;
+        }
+      }else if(dif < 0){
+        // full
+        return false;
+      }else{
+        pos = push_pos.load(memory_order_relaxed);
+      }
+    }
+  }
+
+  bool pop(T& value)
+  {
+    size_t pos = pop_pos.load(memory_order_relaxed);
+    while(true){
+      Cell& cell = cells[pos & mask];
+      size_t seq = cell.seq.load(memory_order_acquire);
+      long dif = (long)seq - (long)(pos + 1);
+      if(dif == 0){
+        if(pop_pos.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)){
+          value = cell.data;
+          cell.seq.store(pos + mask + 1, memory_order_release);
+          return true;
+        }
+      }else if(dif < 0){
+        // empty
+        return false;
+      }else{
+        pos = pop_pos.load(memory_order_relaxed);
+      }
+    }
+  }
+}; // end BoundedQueue class
+
+#endif
@@ -0,0 +1,45 @@
+/* Checkpoints for long SmallP_Carmichael tabulations.
+ * Andrew Shallue, part of Tabulating Carmichaels project
+ */
+
+#include "Checkpoint.h"
+
+using namespace std;
+
+Checkpoint::Checkpoint(){
+  start = 0;  stop = 0;
+  processor = 0;  num_threads = 1;
+  X = 0;  bounded = false;
+  next_P = 0;  num_admissable = 0;  offset = 0;
+}
+
+bool Checkpoint::read(string checkpoint_file){
+  ifstream input;
+  input.open(checkpoint_file);
+  if(!input.is_open()) return false;
+
+  string line;
+  if(!getline(input, line)) return false;
+  istringstream fields(line);
+  return (bool)(fields >> start >> stop >> processor >> num_threads >> cars_file >> X >> bounded
+                       >> next_P >> num_admissable >> offset);
+}
+
+void Checkpoint::write(string checkpoint_file){
+  string temp_file = checkpoint_file + ".tmp";
+
+  ofstream output;
+  output.open(temp_file);
+  output << start << " " << stop << " " << processor << " " << num_threads << " " << cars_file << " ";
+  output << X << " " << bounded << " ";
+  output << next_P << " " << num_admissable << " " << offset << "\n";
+  output.close();
+
+  rename(temp_file.c_str(), checkpoint_file.c_str());
+}
+
+bool Checkpoint::same_job(const Checkpoint& other){
+  return start == other.start && stop == other.stop && processor == other.processor && 
+         num_threads == other.num_threads && cars_file == other.cars_file && 
+         X == other.X && bounded == other.bounded;
+}
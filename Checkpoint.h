@@ -0,0 +1,57 @@
+/* Checkpoints for long SmallP_Carmichael tabulations.
+ * Andrew Shallue, part of Tabulating Carmichaels project
+ *
+ * A checkpoint records how far a tabulate_car_interval job has got: every pre-product below next_P has 
+ * been done, num_admissable admissable pre-products were counted on the way, and the first offset bytes 
+ * of cars_file hold exactly their Carmichaels.  The job itself is identified by its interval, processor, 
+ * thread count, output file, Carmichael bound X and whether the tabulation is bounded, so a checkpoint 
+ * is only used to resume the same job.
+ * To resume, truncate cars_file to offset and restart the sieve at next_P.
+ *
+ * The file is one line of text, written to a temporary file and renamed, so a job killed while writing 
+ * leaves the previous checkpoint intact.
+ */
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include "int.h"
+#include "bigint.h"
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+
+using namespace std;
+
+class Checkpoint
+{
+public:
+  // the job
+  int64 start;
+  int64 stop;
+  long processor;
+  long num_threads;
+  string cars_file;
+  bigint X;
+  bool bounded;
+
+  // progress
+  int64 next_P;
+  int64 num_admissable;
+  int64 offset;
+
+  Checkpoint();
+
+  // read checkpoint_file.  Returns false if there is no checkpoint or it can't be parsed.
+  bool read(string checkpoint_file);
+
+  // write checkpoint_file, replacing any earlier checkpoint
+  void write(string checkpoint_file);
+
+  // true if other is a checkpoint for the same job
+  bool same_job(const Checkpoint& other);
+};
+
+#endif
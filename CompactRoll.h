@@ -0,0 +1,83 @@
+/* Compact roll for the incremental sieve.
+   Written by Andrew Shallue, replacing the array of Stack objects in Factgen.
+
+   The old roll was 2*(1+sqrt(stop)) Stacks, each holding 20 longs plus a top index,
+   so about 168 bytes per position.  But each prime sits in exactly one stack at a time,
+   so almost all of that space is empty.  Here the roll is a ring of buckets stored as
+   linked lists threaded through two arrays of 32-bit indices:
+     head[b] is the index of the prime on top of bucket b, or -1 if the bucket is empty
+     link[k] is the index of the prime below prime k in its bucket, or -1
+   Prime k is primes[k], read from the shared prime base, so prime values are never truncated.
+   The base is held as a vector pointer, since extending the base may move its data.
+   Memory is 4 bytes per bucket plus 4 bytes per prime, and a bucket has no limit on its length.
+
+   push and pop work at the head of the list, so primes come off a bucket in the same
+   order they would come off a Stack.
+
+   The arrays come from big_alloc (see Placement.h), so a large roll can be backed by huge pages.
+
+   As with Stack, there is no bounds checking.
+*/
+
+#include "int.h"
+#include "Placement.h"
+#include <vector>
+
+using namespace std;
+
+#ifndef COMPACTROLL_H
+#define COMPACTROLL_H
+
+class CompactRoll
+{
+public:
+  int32* head;          // top prime index in each bucket
+  int32* link;          // next prime index down, one entry per prime
+  const vector<int64>* primes;  // prime values, indexed the same way as link
+  long size;            // number of buckets in use
+  long bucket_cap;      // buckets allocated
+  long link_cap;        // link entries allocated
+
+public:
+  CompactRoll() { head = nullptr; link = nullptr; primes = nullptr; size = 0; bucket_cap = 0; link_cap = 0; }
+  ~CompactRoll() { big_free(head, bucket_cap * sizeof(int32)); big_free(link, link_cap * sizeof(int32)); }
+
+  CompactRoll(const CompactRoll& other) { head = nullptr; link = nullptr; bucket_cap = 0; link_cap = 0; *this = other; }
+
+  CompactRoll& operator=(const CompactRoll& other)
+  {
+    reset(other.size, other.link_cap, other.primes);
+    for(long b = 0; b < size; ++b) head[b] = other.head[b];
+    for(long k = 0; k < other.link_cap; ++k) link[k] = other.link[k];
+    return *this;
+  }
+
+  // empty all buckets, re-allocating only if there is not enough room
+  inline void reset(long buckets, long num_primes, const vector<int64>* ps)
+  {
+    if(buckets > bucket_cap){
+      big_free(head, bucket_cap * sizeof(int32));
+      head = (int32*)big_alloc(buckets * sizeof(int32));
+      bucket_cap = buckets;
+    }
+    if(num_primes > link_cap){
+      big_free(link, link_cap * sizeof(int32));
+      link = (int32*)big_alloc(num_primes * sizeof(int32));
+      link_cap = num_primes;
+    }
+    size = buckets;
+    primes = ps;
+    for(long b = 0; b < size; ++b) head[b] = -1;
+  }
+
+  // put prime index k on top of bucket b
+  inline void push(long b, int32 k) { link[k] = head[b]; head[b] = k; }
+  // take the top prime index off bucket b
+  inline int32 pop(long b)           { int32 k = head[b]; head[b] = link[k]; return k; }
+
+  inline bool isempty(long b)        { return(head[b] < 0); }
+  // value of the top prime in bucket b
+  inline int64 gettop(long b)        { return (*primes)[ head[b] ]; }
+}; // end CompactRoll class
+
+#endif
@@ -0,0 +1,346 @@
+/* Multi-process coordinator for tabulations.
+ * Andrew Shallue, part of Tabulating Carmichaels project
+ */
+
+#include "Coordinator.h"
+#include <chrono>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <ctime>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <utime.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+using namespace std;
+
+Coordinator::Coordinator(string manifest_file, string work_dir_val, long num_workers_val,
+                         function<void(ManifestEntry&, string)> run_unit_val){
+  work_dir = work_dir_val;
+  num_workers = (num_workers_val < 1) ? 1 : num_workers_val;
+  run_unit = run_unit_val;
+  lease_seconds = 600;
+  max_failures = 3;
+  pin_workers = false;
+  next_scan = 0;
+
+  if(!M.read(manifest_file)) M.entries.clear();
+
+  char host[256];
+  if(gethostname(host, sizeof(host)) != 0) host[0] = 0;
+  host[sizeof(host) - 1] = 0;
+  node_name = string(host) + ":" + to_string(getpid());
+}
+
+string Coordinator::path(string name, long id){
+  return work_dir + "/" + name + to_string(id);
+}
+
+bool Coordinator::is_done(long id){
+  struct stat st;
+  return stat(path("done.", id).c_str(), &st) == 0;
+}
+
+/* Take unit id.  The claim file is created with O_EXCL, so only one coordinator can hold it.
+ * A claim older than lease_seconds is moved aside with rename, which is atomic, and then claimed afresh.
+ * If two coordinators race for the same stale claim, at worst the unit is done twice, which only
+ * rewrites the same output.
+ */
+bool Coordinator::claim(long id){
+  string claim_file = path("claim.", id);
+
+  for(long attempt = 0; attempt < 2; ++attempt){
+    int fd = open(claim_file.c_str(), O_CREAT | O_EXCL | O_WRONLY, 0664);
+    if(fd >= 0){
+      string contents = node_name + "\n";
+      if(write(fd, contents.data(), contents.size()) < 0) cout << "Error in Coordinator::claim, writing " << claim_file << "\n";
+      close(fd);
+      return true;
+    }
+    if(errno != EEXIST || attempt > 0) return false;
+
+    // someone holds it.  Is the claim stale?
+    struct stat st;
+    if(stat(claim_file.c_str(), &st) != 0) continue;
+    if(difftime(time(nullptr), st.st_mtime) < lease_seconds || is_done(id)) return false;
+
+    string aside = claim_file + ".stale." + node_name;
+    if(rename(claim_file.c_str(), aside.c_str()) != 0) return false;
+    // another coordinator may have just taken it over.  If so, put its claim back.
+    if(stat(aside.c_str(), &st) == 0 && difftime(time(nullptr), st.st_mtime) < lease_seconds){
+      if(link(aside.c_str(), claim_file.c_str()) != 0) cout << "Error in Coordinator::claim, restoring " << claim_file << "\n";
+      unlink(aside.c_str());
+      return false;
+    }
+    unlink(aside.c_str());
+    cout << node_name << " taking over stale unit " << id << "\n";
+  }
+  return false;
+}
+
+// touch the claims still held, so other coordinators know this one is alive
+void Coordinator::refresh_claims(){
+  for(long id = 0; id < held.size(); ++id){
+    if(held[id]) utime(path("claim.", id).c_str(), nullptr);
+  }
+}
+
+void Coordinator::record_done(long id, int pid, double seconds){
+  ManifestEntry& e = M.entries[id];
+  string done_file = path("done.", id);
+  string temp_file = done_file + ".tmp." + node_name;
+
+  ofstream record;
+  record.open(temp_file);
+  record << "unit " << id << " node " << node_name << " pid " << pid << " seconds " << seconds;
+  record << " kind " << e.kind << " key " << e.key << " start " << e.start << " stop " << e.stop;
+  record << " output " << path("cars_unit", id) << ".txt\n";
+  record.close();
+  rename(temp_file.c_str(), done_file.c_str());
+}
+
+// collect the completion records of every unit into completed.txt
+void Coordinator::write_summary(){
+  string summary_file = work_dir + "/completed.txt";
+  string temp_file = summary_file + ".tmp." + node_name;
+
+  ofstream summary;
+  summary.open(temp_file);
+  for(long id = 0; id < M.entries.size(); ++id){
+    ifstream record(path("done.", id));
+    string line;
+    if(getline(record, line)) summary << line << "\n";
+  }
+  summary.close();
+  rename(temp_file.c_str(), summary_file.c_str());
+}
+
+void Coordinator::spawn(long w){
+  int sv[2];
+  if(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0){
+    cout << "Error in Coordinator::spawn, socketpair failed\n";
+    workers[w].pid = -1;
+    workers[w].fd = -1;
+    workers[w].unit = -1;
+    return;
+  }
+
+  // make sure nothing buffered is written twice
+  cout.flush();
+
+  int pid = fork();
+  if(pid == 0){
+    // child: keep only its own end of its own socket
+    close(sv[0]);
+    for(long k = 0; k < workers.size(); ++k){
+      if(k != w && workers[k].fd >= 0) close(workers[k].fd);
+    }
+    // pinned before any unit runs, so everything the worker allocates is on its node
+    if(pin_workers) pin_worker(w);
+    worker_loop(sv[1]);
+    cout.flush();
+    _exit(0);
+  }
+
+  close(sv[1]);
+  workers[w].pid = pid;
+  workers[w].fd = (pid > 0) ? sv[0] : -1;
+  workers[w].unit = -1;
+  workers[w].buffer.clear();
+  if(pid < 0){
+    cout << "Error in Coordinator::spawn, fork failed\n";
+    close(sv[0]);
+  }
+}
+
+/* Worker side of the protocol.  The coordinator sends lines "unit <id>", the worker runs the unit
+ * and answers "done <id> <seconds>".  The worker exits when the socket closes or on any other line.
+ */
+void Coordinator::worker_loop(int fd){
+  string buffer;
+  char chunk[256];
+
+  while(true){
+    size_t newline;
+    while((newline = buffer.find('\n')) == string::npos){
+      ssize_t n = read(fd, chunk, sizeof(chunk));
+      if(n <= 0) return;
+      buffer.append(chunk, n);
+    }
+    string line = buffer.substr(0, newline);
+    buffer.erase(0, newline + 1);
+
+    istringstream fields(line);
+    string command;
+    long id;
+    if(!(fields >> command >> id) || command != "unit") return;
+
+    auto start = chrono::steady_clock::now();
+    run_unit(M.entries[id], path("cars_unit", id) + ".txt");
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+    string reply = "done " + to_string(id) + " " + to_string(elapsed.count()) + "\n";
+    if(write(fd, reply.data(), reply.size()) < 0) return;
+  }
+}
+
+long Coordinator::next_unit(){
+  if(requeued.size() > 0){
+    long id = requeued.front();
+    requeued.pop_front();
+    return id;
+  }
+
+  while(next_scan < M.entries.size()){
+    long id = next_scan;
+    next_scan++;
+    if(held[id] || failures[id] >= max_failures || is_done(id)) continue;
+    if(claim(id)){
+      held[id] = true;
+      return id;
+    }
+  }
+  return -1;
+}
+
+bool Coordinator::run(){
+  long num_units = M.entries.size();
+  if(num_units == 0){
+    cout << "Coordinator: no units to run\n";
+    return false;
+  }
+
+  // a worker dying must not kill the coordinator when it next writes to that socket
+  signal(SIGPIPE, SIG_IGN);
+  mkdir(work_dir.c_str(), 0775);
+
+  failures.assign(num_units, 0);
+  held.assign(num_units, false);
+  next_scan = 0;
+
+  workers.resize(num_workers);
+  for(long w = 0; w < num_workers; ++w) workers[w].fd = -1;
+  for(long w = 0; w < num_workers; ++w) spawn(w);
+
+  auto last_refresh = chrono::steady_clock::now();
+
+  while(true){
+    // hand out units to idle workers
+    for(long w = 0; w < num_workers; ++w){
+      if(workers[w].fd < 0 || workers[w].unit != -1) continue;
+      long id = next_unit();
+      if(id < 0) break;
+
+      string message = "unit " + to_string(id) + "\n";
+      workers[w].unit = id;
+      if(write(workers[w].fd, message.data(), message.size()) < 0){
+        // the worker is gone; poll will report it
+        cout << "Coordinator: could not send unit " << id << " to worker " << workers[w].pid << "\n";
+      }
+    }
+
+    long busy = 0;
+    for(long w = 0; w < num_workers; ++w){
+      if(workers[w].unit != -1) busy++;
+    }
+
+    if(busy == 0){
+      // Nothing to run here.  Either every unit is finished, or the rest are claimed by other coordinators.
+      bool all_finished = true;
+      for(long id = 0; id < num_units; ++id){
+        if(!is_done(id) && failures[id] < max_failures){
+          all_finished = false;
+          break;
+        }
+      }
+      if(all_finished) break;
+
+      // wait a while, then look again for claims that have gone stale
+      long wait = (lease_seconds / 4 < 5) ? (long)(lease_seconds / 4) + 1 : 5;
+      sleep(wait);
+      next_scan = 0;
+      continue;
+    }
+
+    // wait for a worker to finish or die
+    vector<pollfd> fds(num_workers);
+    for(long w = 0; w < num_workers; ++w){
+      fds[w].fd = workers[w].fd;
+      fds[w].events = POLLIN;
+      fds[w].revents = 0;
+    }
+    poll(fds.data(), num_workers, 1000);
+
+    for(long w = 0; w < num_workers; ++w){
+      if(fds[w].fd < 0 || fds[w].revents == 0) continue;
+
+      char chunk[256];
+      ssize_t n = read(workers[w].fd, chunk, sizeof(chunk));
+      if(n > 0){
+        workers[w].buffer.append(chunk, n);
+        size_t newline;
+        while((newline = workers[w].buffer.find('\n')) != string::npos){
+          istringstream fields(workers[w].buffer.substr(0, newline));
+          workers[w].buffer.erase(0, newline + 1);
+          string command;
+          long id;
+          double seconds;
+          if(fields >> command >> id >> seconds && command == "done" && id == workers[w].unit){
+            record_done(id, workers[w].pid, seconds);
+            held[id] = false;
+            workers[w].unit = -1;
+          }
+        }
+        continue;
+      }
+
+      // the worker died.  Put its unit back on the queue and start a new worker.
+      long id = workers[w].unit;
+      waitpid(workers[w].pid, nullptr, 0);
+      close(workers[w].fd);
+      workers[w].fd = -1;
+      cout << "Coordinator: worker " << workers[w].pid << " died";
+      if(id >= 0){
+        failures[id]++;
+        cout << " running unit " << id;
+        if(failures[id] < max_failures){
+          requeued.push_back(id);
+        }else{
+          cout << ", which has now failed " << failures[id] << " times and is given up";
+          held[id] = false;
+        }
+      }
+      cout << "\n";
+      spawn(w);
+    }
+
+    // keep the claims fresh
+    chrono::duration<double> since_refresh = chrono::steady_clock::now() - last_refresh;
+    if(since_refresh.count() > lease_seconds / 4){
+      refresh_claims();
+      last_refresh = chrono::steady_clock::now();
+    }
+  }
+
+  // shut down the workers
+  for(long w = 0; w < num_workers; ++w){
+    if(workers[w].fd >= 0){
+      close(workers[w].fd);
+      waitpid(workers[w].pid, nullptr, 0);
+    }
+  }
+
+  bool all_done = true;
+  for(long id = 0; id < num_units; ++id){
+    if(!is_done(id)){
+      cout << "Coordinator: unit " << id << " was not completed\n";
+      all_done = false;
+    }
+  }
+  if(all_done) write_summary();
+  return all_done;
+}
@@ -0,0 +1,91 @@
+/* Multi-process coordinator for tabulations, replacing the MPI version of tab_parallel.
+ * Andrew Shallue, part of Tabulating Carmichaels project
+ *
+ * The work is the list of units in a manifest (see Manifest.h), each a pre-product interval or a range
+ * of large prefixes.  A coordinator runs on each machine.  It forks num_workers worker processes, each
+ * connected to it by a Unix domain socket, and hands them one unit at a time as they finish.
+ *
+ * Coordinators on different machines share the work through a directory on a shared filesystem:
+ *   claim.<id>   created with O_EXCL by the coordinator that takes unit id.  The coordinator touches
+ *                its claims while it holds them, so a claim not touched for lease_seconds belongs to a
+ *                coordinator that has died, and another may take the unit over.
+ *   done.<id>    completion record for unit id: node, worker pid, seconds, output file.  Written to a
+ *                temporary name and renamed, so it appears only once complete.
+ *   cars_unit<id>.txt   output of unit id.  A unit that is redone overwrites it.
+ *   completed.txt       all completion records in order of unit, written once every unit is done.
+ * On one machine, the same directory works as well without any sharing.
+ *
+ * If a worker dies, its unit goes back on the queue and a new worker is forked.  A unit that has
+ * killed max_failures workers is given up on and reported, rather than retried forever.
+ */
+
+#ifndef COORDINATOR_H
+#define COORDINATOR_H
+
+#include "Manifest.h"
+#include "Placement.h"
+#include <vector>
+#include <deque>
+#include <string>
+#include <functional>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+
+using namespace std;
+
+class Coordinator
+{
+public:
+  Manifest M;
+  string work_dir;
+  long num_workers;
+  double lease_seconds;       // a claim older than this with no completion record may be taken over
+  long max_failures;          // worker deaths allowed per unit
+  bool pin_workers;           // pin worker w to a CPU, spreading workers over the NUMA nodes (see Placement.h)
+  string node_name;           // host:pid, written into claims and completion records
+
+  // does the work for a unit, writing Carmichaels to output_file.  Runs in a worker process.
+  function<void(ManifestEntry&, string)> run_unit;
+
+private:
+  // one record per worker process
+  class Worker
+  {
+  public:
+    int pid;
+    int fd;          // coordinator end of the socket
+    long unit;       // unit in progress, -1 if idle
+    string buffer;   // partial line read from the worker
+  };
+
+  vector<Worker> workers;
+  deque<long> requeued;        // units this coordinator holds whose worker died
+  vector<long> failures;       // worker deaths per unit
+  vector<bool> held;           // units this coordinator has claimed and not finished
+  long next_scan;              // units below next_scan have been tried for a claim
+
+  string path(string name, long id);
+  bool is_done(long id);
+  bool claim(long id);
+  void refresh_claims();
+  void record_done(long id, int pid, double seconds);
+  void write_summary();
+
+  // start a worker process.  The child runs worker_loop and never returns.
+  void spawn(long w);
+  void worker_loop(int fd);
+
+  // the next unit for an idle worker, or -1 if there is none to be had right now
+  long next_unit();
+
+public:
+  Coordinator(string manifest_file, string work_dir_val, long num_workers_val,
+              function<void(ManifestEntry&, string)> run_unit_val);
+
+  // hand out units until every unit in the manifest has a completion record (or has been given up on).
+  // Returns true if every unit was completed, false otherwise or if the manifest could not be read.
+  bool run();
+};
+
+#endif
@@ -2,18 +2,72 @@
    Code written by Jonathan Sorenson
    Comments by Andrew Shallue, Factgen2 by Andrew Shallue.
 
-   Note: only works for factorizations up to 20 primes.
+   Note: only works for factorizations up to 20 primes.  FactgenBlock has no such limit.
 */
 
 #include "Factgen.h"
 
 using namespace std;
 
+/*********************************
+* Shared prime base
+**********************************/
+
+PrimeBase& prime_base(int64 bound){
+  static PrimeBase base = { vector<int64>(), vector<double>(), 0 };
+
+  if(bound > base.bound){
+    // extend to at least double the old bound, so repeated small extensions stay cheap
+    int64 new_bound = (2 * base.bound > bound) ? 2 * base.bound : bound;
+
+    // sieve of Eratosthenes on [0, new_bound)
+    vector<char> composite(new_bound, 0);
+    for(int64 i = 2; i * i < new_bound; ++i){
+      if(!composite[i]){
+        for(int64 j = i * i; j < new_bound; j += i) composite[j] = 1;
+      }
+    }
+
+    // append the primes not already in the base
+    int64 first = (base.bound > 2) ? base.bound : 2;
+    for(int64 i = first; i < new_bound; ++i){
+      if(!composite[i]){
+        base.primes.push_back(i);
+        base.inverses.push_back(1.0 / i);
+      }
+    }
+    base.bound = new_bound;
+  }
+  return base;
+}
+
+// binary search in the shared base
+long prime_count_below(int64 bound){
+  PrimeBase& base = prime_base(bound);
+  return lower_bound(base.primes.begin(), base.primes.end(), bound) - base.primes.begin();
+}
+
+// distance from start to the next multiple of each p, using reciprocals instead of division
+void start_offsets(const int64* ps, const double* invs, long len, int64 start, int64* out){
+  double start_d = (double)start;
+  for(long k = 0; k < len; ++k){
+    int64 p = ps[k];
+    int64 r = start - (int64)(start_d * invs[k]) * p;
+    // the estimate of start / p may be one off in either direction
+    r += (r < 0) ? p : 0;
+    r -= (r >= p) ? p : 0;
+    out[k] = (r == 0) ? 0 : p - r;
+  }
+}
+
+/*********************************
+* Methods for Factgen
+**********************************/
+
 // not useful, default values
 Factgen::Factgen(){
 
-  // roll had space for one Stack
-  roll = nullptr;
+  // roll is empty until init
   rollsize = 0;
   pos = 0;
   prevlen = 0;
@@ -23,9 +77,8 @@ Factgen::Factgen(){
   n = 0;
 }
 
-// delete the roll
+// the roll frees its own memory
 Factgen::~Factgen(){
-  delete[] roll;
 }  
  
 // copy constructor.  Copies over values, and allocates memory for its own roll
@@ -39,15 +92,13 @@ Factgen::Factgen(const Factgen& other_f){
   stop = other_f.stop;
   n = other_f.n;
 
-  // allocate memory for roll and copy over
-  roll = new Stack[rollsize];
-  for(long i = 0; i < rollsize; ++i){
-    roll[i] = other_f.roll[i];
-  }
+  // CompactRoll allocates its own memory and copies over
+  roll = other_f.roll;
 
   // copy over prev array
   for(long i = 0; i < prevlen; ++i){
     prev[i] = other_f.prev[i];
+    prevexp[i] = other_f.prevexp[i];
   }  
 
 }
@@ -66,29 +117,29 @@ Factgen Factgen::operator=(const Factgen& other_f){
   result_f.stop = other_f.stop;
   result_f.n = other_f.n;
 
-  // allocate memory for roll and copy over
-  result_f.roll = new Stack[rollsize];
-  for(long i = 0; i < rollsize; ++i){
-    result_f.roll[i] = other_f.roll[i];
-  }
+  // CompactRoll allocates its own memory and copies over
+  result_f.roll = other_f.roll;
 
   // copy over prev array
   for(long i = 0; i < prevlen; ++i){
     result_f.prev[i] = other_f.prev[i];
+    result_f.prevexp[i] = other_f.prevexp[i];
   }
   return result_f;
 }  
  
 // I would have made this a non-standard constructor
 // Complexity is O(sqrt(B)) time and space
+// Update: primes now come from the shared prime base, and the roll is only re-allocated 
+// if it is too small.  Otherwise the buckets are emptied and reused.
 void Factgen::init(int64 startint, int64 stopint){
 
-  // clear the roll, then re-allocate
   // memory needed is double the squareroot of the upper bound
-  if(roll != NULL) delete[] roll;
   rollsize = 1 + sqrt(stopint);
   rollsize = 2 * rollsize;
-  roll = new Stack[rollsize];
+  long num_primes = prime_count_below(rollsize);
+  PrimeBase& base = prime_base(rollsize);
+  roll.reset(rollsize, num_primes, &base.primes);
 
   // set stop and start, then prev stuff to 0
   // Note that pos corresponds to n.  Initially, n = start and pos = 0
@@ -99,14 +150,17 @@ void Factgen::init(int64 startint, int64 stopint){
   prevn = 0;
   pos = 0;
 
-  // for primes up to the rollsize, push p onto the stack 
+  // for primes up to the rollsize, push p onto the bucket 
   // at position (p - start % p) % p.  Notice each prime only 
-  // pushed onto one stack.
-  for(long p = rollsize - 1; p >= 2; p--)
-    if(primetest(p))
-    {
-      roll[ (p - (start % p)) % p ].push(p);
-    }
+  // pushed onto one bucket.  Primes pushed largest first, so they pop in increasing order.
+  // The roll stores the index of p in the prime base, rather than p itself.
+  int64* offs = new int64[num_primes];
+  start_offsets(base.primes.data(), base.inverses.data(), num_primes, start, offs);
+  for(long k = num_primes - 1; k >= 0; k--)
+  {
+    roll.push(offs[k], k);
+  }
+  delete[] offs;
 //cout << "rollsize=" << rollsize << endl;
 }
 
@@ -124,21 +178,25 @@ void Factgen::next(){
 
   // here is the factorization loop
   // continue until no more primes to grab
-  while( !roll[pos].isempty() )
+  const vector<int64>& base_primes = *roll.primes;
+  while( !roll.isempty(pos) )
   {
     // pop prime p off of factorization for n, 
     // then add to factorization of the next multiple of p
-    int64 p = roll[pos].pop();
-    roll[ (pos + p) % rollsize ].push(p);
-
-    // add p to factorization of previous n
-    prev[ prevlen++ ] = p;
-    while(r % p == 0) { r = r / p; } // cout << "div\n"; }
+    int32 k = roll.pop(pos);
+    int64 p = base_primes[k];
+    roll.push( (pos + p) % rollsize, k );
+
+    // add p to factorization of previous n, recording the exponent as we divide it out
+    prev[ prevlen ] = p;
+    prevexp[ prevlen ] = 0;
+    while(r % p == 0) { r = r / p; prevexp[ prevlen ]++; } // cout << "div\n"; }
+    prevlen++;
   }
   // It is possible that n is prime and greater than rollsize.
   // If so, then its stack will be empty.  We detect this by checking r, then add it to factorization.
   if(r > 1)
-    { prev[ prevlen++ ] = r; }
+    { prev[ prevlen ] = r;  prevexp[ prevlen ] = 1;  prevlen++; }
 
   // increment n, and increment position to match
   n++;
@@ -147,7 +205,7 @@ void Factgen::next(){
 
 // A number is prime if its top factor is itself
 bool Factgen::isprime(){
-  return (roll[pos].isempty() || roll[pos].gettop() == n);
+  return (roll.isempty(pos) || roll.gettop(pos) == n);
 }
 
 // find next prime through repeated calls to next()
@@ -161,11 +219,12 @@ int64 Factgen::nextprime(){
 void Factgen::print()
   {
     cout << "n=" << n << endl;
-    cout << "Empty?" << roll[pos].isempty() << endl;
-    cout << "stack top=" << roll[pos].gettop() << endl;
+    cout << "Empty?" << roll.isempty(pos) << endl;
+    cout << "stack top=" << roll.gettop(pos) << endl;
   }
 
 // Generate a vector of all divisors of prevn from the list of prime factors
+// Update: prime powers come from the exponents in prevexp, rather than dividing prevn
 vector<int64> Factgen::prevn_divisors(){
 
   // initialize output divisors list with 1
@@ -186,12 +245,10 @@ vector<int64> Factgen::prevn_divisors(){
     p = prev[i];
     p_powers.clear();
     p_pow = p;
-    while(prevn % p_pow == 0){
+    for(long e = 0; e < prevexp[i]; ++e){
       p_powers.push_back(p_pow);
       p_pow = p_pow * p;
     }
-    // loop stops when p_pow is one step too big
-    p_pow = p_pow / p;
 
     // For each prime power in turn, multiply it by all the divs (using divs_copy)
     // then push onto the divs_temp vector.
@@ -212,57 +269,340 @@ vector<int64> Factgen::prevn_divisors(){
   return divs;
 }
 
+/*********************************
+* Methods for FactgenBlock
+**********************************/
+
+// not useful, default values.  init is the function which sets values
+FactgenBlock::FactgenBlock(){
+  num_sieve_primes = 0;
+  block_start = 0;
+  block_len = 0;
+  block_max = 0;
+  pos = 0;
+  prev = nullptr;
+  prevexp = nullptr;
+  prevlen = 0;
+  prevn = 0;
+  start = 0;
+  stop = 0;
+  n = 0;
+}
+
+// copy constructor.  The vectors copy themselves, but prev has to point into our own factors array
+FactgenBlock::FactgenBlock(const FactgenBlock& other){
+  *this = other;
+}
+
+// assignment operator, same idea as the copy constructor
+FactgenBlock& FactgenBlock::operator=(const FactgenBlock& other){
+  num_sieve_primes = other.num_sieve_primes;
+  starts = other.starts;
+  cofactor = other.cofactor;
+  fill = other.fill;
+  factors = other.factors;
+  exponents = other.exponents;
+  offsets = other.offsets;
+  block_start = other.block_start;
+  block_len = other.block_len;
+  block_max = other.block_max;
+  pos = other.pos;
+  prevlen = other.prevlen;
+  prevn = other.prevn;
+  start = other.start;
+  stop = other.stop;
+  n = other.n;
+
+  // prev is the factorization at position pos - 1, if there is one
+  prev = (pos > 0) ? &factors[ offsets[pos - 1] ] : nullptr;
+  prevexp = (pos > 0) ? &exponents[ offsets[pos - 1] ] : nullptr;
+  return *this;
+}
+
+// Find the sieving primes, then sieve the first block.
+// The primes are the same as those Factgen pushes onto its roll, so the two produce identical output.
+void FactgenBlock::init(int64 startint, int64 stopint, long blocksize){
+  stop = stopint;
+  start = startint;
+  n = start;
+  prev = nullptr;
+  prevexp = nullptr;
+  prevlen = 0;
+  prevn = 0;
+
+  // sieving primes come from the shared base.  The vectors keep their memory between calls to init.
+  long prime_bound = 1 + sqrt(stopint);
+  prime_bound = 2 * prime_bound;
+  num_sieve_primes = prime_count_below(prime_bound);
+
+  // start with a short block, since the P+D sieve often only needs a few values.
+  // Blocks double in length up to blocksize.
+  block_max = blocksize;
+  block_len = (block_max < 1024) ? block_max : 1024;
+  sieve_block(start);
+  pos = 0;
+}
+
+/* Sieve the integers lo, lo+1, ..., lo + block_len - 1.
+ * First pass: for every prime p, count it in the factorization of each multiple, and multiply 
+ * the full power of p into the smooth part of each multiple (multiples of p^2, p^3, ... get an extra p each).
+ * A single division n / smooth part then gives the cofactor, rather than dividing by every prime.
+ * The cofactor is 1 or a prime larger than every sieving prime used, so it goes last.
+ * Then a prefix sum turns the counts into offsets, and the second pass writes the primes.
+ * Exponents start at 1 when a prime is written, and multiples of p^2, p^3, ... add one each.
+ * The prime 2 is always the first sieving prime, and is handled with a trailing zero count.
+ * Only primes with p^2 <= lo + block_len - 1 are needed, any larger prime factor is found as the cofactor.
+ */
+void FactgenBlock::sieve_block(int64 lo){
+  block_start = lo;
+  int64 hi = lo + block_len - 1;
+
+  cofactor.assign(block_len, 1);
+  offsets.assign(block_len + 1, 0);
+  fill.resize(block_len);
+
+  // find how many of the sieving primes are needed for this block
+  const PrimeBase& base = prime_base(0);
+  const int64* sieve_primes = base.primes.data();
+  long num_primes = 0;
+  while(num_primes < num_sieve_primes && sieve_primes[num_primes] * sieve_primes[num_primes] <= hi){
+    num_primes++;
+  }
+
+  // offsets of the first multiple of each prime in the block
+  starts.resize(num_primes);
+  start_offsets(sieve_primes, base.inverses.data(), num_primes, lo, starts.data());
+
+  // first pass, counts stored one ahead in offsets so that the prefix sum lines up.
+  // The prime 2 is done on its own: its exponent is the count of trailing zero bits, 
+  // which saves looping over multiples of 4, 8, 16, ...
+  if(num_primes > 0){
+    for(long j = starts[0]; j < block_len; j += 2){
+      offsets[j + 1]++;
+      cofactor[j] = (int64)1 << __builtin_ctzll(lo + j);
+    }
+  }
+  for(long k = 1; k < num_primes; ++k){
+    int64 p = sieve_primes[k];
+    for(long j = starts[k]; j < block_len; j += p){
+      offsets[j + 1]++;
+      cofactor[j] *= p;
+    }
+    for(int64 pk = p * p; pk <= hi; pk *= p){
+      for(long j = (pk - (lo % pk)) % pk; j < block_len; j += pk){
+        cofactor[j] *= p;
+      }
+    }
+  }
+  for(long i = 0; i < block_len; ++i){
+    cofactor[i] = (lo + i) / cofactor[i];
+    if(cofactor[i] > 1) offsets[i + 1]++;
+  }
+
+  // prefix sum, then allocate the flat factor array
+  for(long i = 0; i < block_len; ++i){
+    offsets[i + 1] += offsets[i];
+    fill[i] = offsets[i];
+  }
+  factors.resize(offsets[block_len]);
+  exponents.resize(offsets[block_len]);
+
+  // second pass, primes in increasing order then the cofactor.
+  // Right after p is written for n, it sits at fill[j] - 1, which is where its exponent goes.
+  if(num_primes > 0){
+    for(long j = starts[0]; j < block_len; j += 2){
+      exponents[ fill[j] ] = __builtin_ctzll(lo + j);
+      factors[ fill[j]++ ] = 2;
+    }
+  }
+  for(long k = 1; k < num_primes; ++k){
+    int64 p = sieve_primes[k];
+    for(long j = starts[k]; j < block_len; j += p){
+      exponents[ fill[j] ] = 1;
+      factors[ fill[j]++ ] = p;
+    }
+    for(int64 pk = p * p; pk <= hi; pk *= p){
+      for(long j = (pk - (lo % pk)) % pk; j < block_len; j += pk){
+        exponents[ fill[j] - 1 ]++;
+      }
+    }
+  }
+  // the cofactor is larger than sqrt(hi), so its exponent is 1
+  for(long i = 0; i < block_len; ++i){
+    if(cofactor[i] > 1){
+      exponents[ fill[i] ] = 1;
+      factors[ fill[i]++ ] = cofactor[i];
+    }
+  }
+}
+
+// Sieve the next block.  It starts at the last n handed out, so that the factorization 
+// of prevn - 1 stays available through before()
+void FactgenBlock::next_block(){
+  int64 last = block_start + block_len - 1;
+  if(block_len < block_max){
+    block_len = (2 * block_len < block_max) ? 2 * block_len : block_max;
+  }
+  sieve_block(last);
+  pos = 1;
+}
+
+// get the next factorization
+void FactgenBlock::next(){
+  // if the block is used up, sieve the next one
+  if(pos == block_len) next_block();
+
+  prevn = n;
+  prev = &factors[ offsets[pos] ];
+  prevexp = &exponents[ offsets[pos] ];
+  prevlen = offsets[pos + 1] - offsets[pos];
+
+  // increment n, and increment position to match
+  n++;
+  pos++;
+}
+
+// Skip k - 1 values, moving through as many blocks as needed, then call next for the last one
+void FactgenBlock::advance(long k){
+  while(pos + k > block_len){
+    k -= block_len - pos;
+    n += block_len - pos;
+    next_block();
+  }
+  pos += k - 1;
+  n += k - 1;
+  next();
+}
+
 /*********************************
 * Methods for Factgen2
 **********************************/
 
+Factgen2::Factgen2(){
+  use_wheel = false;
+  prev = nullptr;
+  current = nullptr;
+  prevexp = nullptr;
+  currentexp = nullptr;
+  prevlen = 0;
+  prevval = 0;
+  currentlen = 0;
+  currentval = 0;
+}
+
+// copy constructor.  Copy the block, then point prev and current into the new copy
+Factgen2::Factgen2(const Factgen2& other){
+  *this = other;
+}
+
+Factgen2& Factgen2::operator=(const Factgen2& other){
+  G = other.G;
+  prevlen = other.prevlen;
+  prevval = other.prevval;
+  currentlen = other.currentlen;
+  currentval = other.currentval;
+  use_wheel = other.use_wheel;
+  for(long i = 0; i < 210; ++i){
+    wheel_gap[i] = other.wheel_gap[i];
+  }
+  if(G.pos >= 2){
+    prev = G.before();
+    prevexp = G.before_exps();
+    current = G.prev;
+    currentexp = G.prevexp;
+  }else{
+    prev = nullptr;
+    prevexp = nullptr;
+    current = nullptr;
+    currentexp = nullptr;
+  }
+  return *this;
+}
+
 // initialize, assign memory
 void Factgen2::init(int64 startint, int64 stopint)
 {
-  // initialize the Factgen
+  // initialize the block sieve, then call next twice so there is a prev and a current
   G.init( startint, stopint);
-  G.next();  // call next so that there is a prev 
-  
-  prev = &factors[0];
-  current = &factors[20];
-  
-  // set prev in Factgen2
-  memcpy(prev, G.prev, sizeof G.prev);
-  
-  prevlen = G.prevlen;
-  prevval = G.prevn ;
-  
-  // get the next factorization
+  G.next();
   G.next();
 
-  // now set current as the new prev
-  memcpy(current, G.prev, sizeof G.prev);
+  prev = G.before();
+  prevexp = G.before_exps();
+  prevlen = G.beforelen();
+  prevval = G.prevn - 1;
+
+  current = G.prev;
+  currentexp = G.prevexp;
   currentlen = G.prevlen;
-  currentval = G.prevn ;
-  
+  currentval = G.prevn;
 }
 
-// call Factgen next(), and update previous and current
+// call FactgenBlock next(), and update previous and current.  No copying, 
+// prev and current point into the block
 void Factgen2::next()
 {
   G.next();
-  
-  // swap prev and current.  Important part is prev takes on the factors of current
-  int64* temp = prev;
-  prev = current;
-  current = temp;
-
-  // copy from G.prev to current
-  memcpy(current, G.prev, sizeof G.prev);
-  
-  // reset len and val variables
+
+  prev = G.before();
+  prevexp = G.before_exps();
   prevlen = currentlen;
   prevval = currentval;
-  
+
+  current = G.prev;
+  currentexp = G.prevexp;
   currentlen = G.prevlen;
   currentval = G.prevn;
 }
 
+// advance to the next odd value (or the next odd value the wheel allows) in one step
+long Factgen2::next_odd()
+{
+  long step = use_wheel ? wheel_gap[currentval % 210] : 2;
+  G.advance(step);
+
+  prev = G.before();
+  prevexp = G.before_exps();
+  prevlen = G.beforelen();
+  prevval = G.prevn - 1;
+
+  current = G.prev;
+  currentexp = G.prevexp;
+  currentlen = G.prevlen;
+  currentval = G.prevn;
+
+  return step;
+}
+
+// For each odd residue r mod 210, find the distance to the next odd residue whose class mod 105 is not skipped
+bool Factgen2::set_wheel(const vector<long>& skip)
+{
+  bool skipped[105];
+  for(long i = 0; i < 105; ++i) skipped[i] = false;
+  for(long i = 0; i < skip.size(); ++i) skipped[ skip.at(i) % 105 ] = true;
+
+  // make sure some residue survives, otherwise next_odd would never stop
+  bool any_left = false;
+  for(long i = 0; i < 105; ++i) any_left = any_left || !skipped[i];
+  if(!any_left){
+    use_wheel = false;
+    return false;
+  }
+
+  for(long r = 1; r < 210; r += 2){
+    long gap = 2;
+    while(skipped[ (r + gap) % 105 ]) gap += 2;
+    wheel_gap[r] = gap;
+  }
+  use_wheel = true;
+  return true;
+}
+
+void Factgen2::clear_wheel()
+{
+  use_wheel = false;
+}
+
 // print both prev and current factorizations
 void Factgen2::print(){
   // print factors for prev
@@ -285,3 +625,72 @@ bool Factgen2::isprime_current(){
   return (currentlen == 1 && current[0] == currentval);
 }
 
+AdmissableSieve::AdmissableSieve(){
+  seg_index = 0;
+  seg_len = 0;
+  start = 0;
+  stop = 0;
+}
+
+/* Collect the moduli and sieve the first segment.  start is rounded up to be odd.
+ * p^2 is used for every odd prime p with p^2 < stop.
+ * p*q is used for odd primes p < q in the base with q = 1 mod p and p*q < stop.
+ */
+void AdmissableSieve::init(int64 startint, int64 stopint, long segsize){
+  start = (startint % 2 == 0) ? startint + 1 : startint;
+  stop = stopint;
+  seg_len = segsize;
+
+  long prime_bound = 1 + sqrt(stopint);
+  prime_bound = 2 * prime_bound;
+  long num_primes = prime_count_below(prime_bound);
+  const vector<int64>& ps = prime_base(prime_bound).primes;
+
+  moduli.clear();
+  for(long i = 1; i < num_primes; ++i){
+    int64 p = ps[i];
+    if(p * p >= stop) break;
+    moduli.push_back(p * p);
+    for(long j = i + 1; j < num_primes && p * ps[j] < stop; ++j){
+      if(ps[j] % p == 1) moduli.push_back(p * ps[j]);
+    }
+  }
+
+  // first odd multiple of each modulus m at least start.  Odd multiples are 2m apart, so m apart in index.
+  next_index.resize(moduli.size());
+  for(long k = 0; k < moduli.size(); ++k){
+    int64 m = moduli[k];
+    int64 c = (start + m - 1) / m;
+    if(c % 2 == 0) c++;
+    next_index[k] = (c * m - start) / 2;
+  }
+
+  bits.resize((seg_len + 63) / 64);
+  sieve_segment(0);
+}
+
+// cross off odd multiples of each modulus that land in the segment
+void AdmissableSieve::sieve_segment(int64 first){
+  seg_index = first;
+  int64 last = first + seg_len;
+  for(long w = 0; w < bits.size(); ++w) bits[w] = 0;
+
+  for(long k = 0; k < moduli.size(); ++k){
+    int64 m = moduli[k];
+    int64 i = next_index[k];
+    // segments may be skipped, so catch up to this one first
+    if(i < first) i += ((first - i + m - 1) / m) * m;
+    for(; i < last; i += m){
+      long b = i - first;
+      bits[b >> 6] |= (uint64)1 << (b & 63);
+    }
+    next_index[k] = i;
+  }
+}
+
+bool AdmissableSieve::maybe_admissable(int64 P){
+  int64 i = (P - start) / 2;
+  if(i >= seg_index + seg_len) sieve_segment(i - (i - seg_index) % seg_len);
+  long b = i - seg_index;
+  return !((bits[b >> 6] >> (b & 63)) & 1);
+}
@@ -3,6 +3,8 @@
    Comments by Andrew Shallue, Factgen2 by Andrew Shallue.
 
    Note: only works for factorizations up to 20 primes.
+   Update: the roll is now a CompactRoll (see CompactRoll.h) rather than an array of Stacks.
+   The 20 prime limit now only applies to prev, and no 64-bit integer has more than 15 distinct primes.
 
    Key function is next().  This takes all the primes in the current factorization, 
    and for each such p pushes it onto the factorization stack for n+p, then increments n 
@@ -12,32 +14,63 @@
    These factorizations are not complete, in the sense that if p^r divides n, p 
    appears only once in the list of factors.  But if p | n, then p must appear, 
    unless n is a prime > start + sqrt(stop), in which case the factorization list is empty.
+
+   Update: next() already divides out each p to find a large prime factor, so it now records 
+   the exponents as well, in prevexp.  Downstream code can use them rather than dividing again.
 */
 
 
 #ifndef FACTGEN_H
 #define FACTGEN_H
 
-#include "Stack.h"
+#include "CompactRoll.h"
 #include <cmath>
 #include "int.h"
 #include "primetest.h"
 #include <vector>
 #include "functions.h"
+#include "Placement.h"
 
 using namespace std;
 
+// Process-wide list of primes, shared by every Factgen and FactgenBlock.  Written by Andrew Shallue.
+// Preproduct loops call init once per preproduct, so rather than primetest every integer up to the 
+// roll size each time, the primes are sieved once and extended whenever a larger bound is requested.
+// Reciprocals are stored alongside for start_offsets.
+// Extending the base is not thread safe.  Threaded code extends it to the largest bound needed before 
+// starting threads, after which every call only reads it.
+struct PrimeBase
+{
+  vector<int64>  primes;    // all primes below bound, in increasing order
+  vector<double> inverses;  // 1.0 / p for each prime
+  int64 bound;
+};
+
+// return the shared prime base, extended if necessary so that it holds all primes below bound
+PrimeBase& prime_base(int64 bound);
+
+// number of primes in the shared base below bound.  Assumes prime_base(bound) has been called.
+long prime_count_below(int64 bound);
+
+/* For each prime p in ps, compute (p - start % p) % p, the distance from start to the next multiple of p.
+ * Written with no hardware divides or branches: start % p comes from the precomputed reciprocal 1/p 
+ * with one correction step, so the loop is a simple candidate for vectorization.
+ * The double estimate of start / p is off by at most 1 provided start < 2^50.
+ */
+void start_offsets(const int64* ps, const double* invs, long len, int64 start, int64* out);
+
 class Factgen
 {
 private:
 
-  Stack *roll;  // An array of stacks, stores factorizations for all numbers in the interval
-  int rollsize; // memory allocated for roll, which is sqrt(B)
-  int pos;      // tracks n, but modulo rollsize, starting at 0
+  CompactRoll roll;  // ring of buckets, stores factorizations for all numbers in the interval
+  long rollsize;     // number of buckets in the roll, which is 2*(1+sqrt(B))
+  long pos;          // tracks n, but modulo rollsize, starting at 0
 
 public:
   // public attributes
   int64 prev[20];      // Factorization of previous n
+  long prevexp[20];    // exponent of each prime in prev
   int prevlen;         // length of factorization of prevn
   int64 prevn;         // previous n
   int64 start, stop;   // upper and lower bounds on the sieve
@@ -52,6 +85,7 @@ public:
   void print();  // print top of the stack
   
   // I would have made this a non-standard constructor
+  // Calling init again reuses the roll allocation when it is big enough
   void init(int64 startint, int64 stopint);
 
   // get the next factorization
@@ -63,30 +97,97 @@ public:
   // find next prime through repeated calls to next()
   int64 nextprime();
 
-  // Generate a vector of all divisors of prevn from the list of prime factors
+  // Generate a vector of all divisors of prevn from the list of prime factors and exponents
   vector<int64> prevn_divisors();
 
 };
 
+// Segmented, cache-blocked version of the incremental sieve.  Written by Andrew Shallue.
+//
+// Factgen moves every prime of n to the stack for n+p, one scattered write per prime factor per n.
+// FactgenBlock instead sieves a whole block of consecutive n at once, storing the factorizations 
+// back to back in a flat array with an offsets array marking where each one starts.  The same 
+// interface as Factgen (next, prev, prevlen, prevn) is provided, so it can stand in for Factgen.
+//
+// Consecutive blocks overlap by one integer, so the factorization of prevn - 1 is always 
+// still in memory.  Factgen2 relies on this to avoid copying factorizations.
+//
+// As with Factgen, factors are unique primes in increasing order.  Assumes startint >= 1.
+// Each factor comes with its exponent, in a second flat array lined up with the factors.
+class FactgenBlock
+{
+private:
+  long num_sieve_primes;       // primes below 2*(1+sqrt(stop)) in the shared prime base, as in the Factgen roll
+  big_vector<int64> starts;        // offset of the first multiple of each sieving prime in the block
+  big_vector<int64> cofactor;      // smooth part of each n during the first pass, then what remains of n
+  big_vector<long>  fill;          // write position for each n while filling the factors array
+
+  // sieve the block of consecutive integers starting at lo, length given by block_len
+  void sieve_block(int64 lo);
+
+  // the current block is used up.  Sieve the next one, starting at the last n handed out.
+  void next_block();
+
+public:
+  big_vector<int64> factors;  // factorizations for the whole block, stored one after another
+  big_vector<long>  exponents;  // exponent of each entry in factors
+  big_vector<long>  offsets;  // factors of block_start + i are in positions offsets[i] up to offsets[i+1]
+  int64 block_start;      // first n in the current block
+  long  block_len;        // number of n in the current block
+  long  block_max;        // largest block length.  The first block is short and doubles up to this.
+  long  pos;              // position of n within the block
+
+  // public attributes matching Factgen.  prev and prevexp point into the factors and exponents arrays.
+  int64* prev;
+  long* prevexp;
+  int prevlen;
+  int64 prevn;
+  int64 start, stop;
+  int64 n;
+
+  FactgenBlock();
+  FactgenBlock(const FactgenBlock& other);
+  FactgenBlock& operator=(const FactgenBlock& other);
+
+  // set up the sieving primes and sieve the first block.  Calling init again reuses the memory.
+  // Default block length 2^14 keeps the factors, exponents and offsets of a block within L2.
+  void init(int64 startint, int64 stopint, long blocksize = 16384);
+
+  // get the next factorization, sieving a new block when the current one runs out
+  void next();
+
+  // same result as calling next() k times, but without setting prev along the way
+  void advance(long k);
+
+  // factorization of prevn - 1.  Only valid once next() has been called at least twice.
+  inline int64* before()  { return &factors[ offsets[pos - 2] ]; }
+  inline long* before_exps()  { return &exponents[ offsets[pos - 2] ]; }
+  inline int beforelen()  { return offsets[pos - 1] - offsets[pos - 2]; }
+};
+
 // Stores and updates 2 factorizations, namely for n and n-1
 // Written by Andrew Shallue, based on code by Jonathan Webster and Jonathan Sorenson
 
 /* Update: if you don't call next, then the initial numbers are startint and startint+1
 
+*/
+/* Update 2: now built on FactgenBlock.  prev and current point directly into the block,
+   so the factorizations are no longer copied on every step.  They are valid until the next call to next().
 */
 class Factgen2
 {
 private:
-  Factgen G;
+  FactgenBlock G;
 
 public:
-  // store the two factorizations in one array, starting at positions 0 and 20
-  int64 factors[40];
-
-  // arrays to break factors into the two lists of factors
+  // the two factorizations, pointing into the block sieve
   int64* prev;
   int64* current;
 
+  // exponents lined up with prev and current
+  long* prevexp;
+  long* currentexp;
+
   // lengths and values
   int prevlen;
   int64 prevval;
@@ -94,12 +195,35 @@ public:
   int currentlen;
   int64 currentval;
 
+  // wheel for next_odd.  wheel_gap[n % 210] is the step from odd n to the next odd value not skipped
+  bool use_wheel;
+  long wheel_gap[210];
+
+  // prev and current point into G, so copies need to re-point them at their own block
+  Factgen2();
+  Factgen2(const Factgen2& other);
+  Factgen2& operator=(const Factgen2& other);
+
   // initialize, assign memory
   void init(int64 startint, int64 stopint);
 
   // call Factgen next(), and update previous and current
   void next();
 
+  /* Odd-only stepping.  Advance by two in one step, so that current is the next odd value P and prev is P-1.
+   * Note P-1 and P together cover every integer, so the block still sieves everything.  What is saved is 
+   * handing out the even value only to throw it away.
+   * If a wheel is set, odd values in skipped residue classes mod 105 are passed over as well.
+   * Returns how far current moved, so callers can keep residue indices in step.
+   */
+  long next_odd();
+
+  // Set the wheel for next_odd.  skip holds residues mod 105 = 3*5*7 the caller declares inadmissible.
+  // Returns false, and leaves the wheel off, if every residue would be skipped.
+  // The value current has when the wheel is set is not itself checked.
+  bool set_wheel(const vector<long>& skip);
+  void clear_wheel();
+
   // print both prev and current factorizations
   void print();
 
@@ -109,4 +233,38 @@ public:
 };
 
 
+// Sieve that rules out inadmissable pre-products.  Written by Andrew Shallue.
+//
+// An odd P is admissable when it is squarefree and no prime p | P divides q - 1 for another prime q | P.
+// Building a Preproduct for every odd P to check this is wasteful, since most P fail.  Instead this 
+// sieves a segment of odd integers at a time, crossing off multiples of p^2, and multiples of p*q for 
+// primes q = 1 mod p.  The result is a bitmap over the odd integers of the segment.
+//
+// The moduli p^2 and p*q use primes from the shared base below 2*(1+sqrt(stop)), as in FactgenBlock.
+// A P that is crossed off is certainly inadmissable.  A P that survives may still be inadmissable 
+// through its one prime factor above that bound, so survivors still need the full check.
+class AdmissableSieve
+{
+private:
+  big_vector<int64> moduli;        // p^2 and p*q, in no particular order
+  big_vector<int64> next_index;    // index of the next odd multiple of each modulus, counting odd integers from start
+  big_vector<uint64> bits;         // bit i is set if the i-th odd integer in the segment is crossed off
+  int64 seg_index;             // index of the first odd integer in the segment
+  long seg_len;                // number of odd integers in a segment
+
+  // cross off the segment beginning at index first
+  void sieve_segment(int64 first);
+
+public:
+  int64 start, stop;   // first odd integer considered, and upper bound
+
+  AdmissableSieve();
+
+  // set up the moduli and sieve the first segment.  Default segment of 2^16 odd integers is an 8KB bitmap.
+  void init(int64 startint, int64 stopint, long segsize = 65536);
+
+  // false if odd P is known to be inadmissable.  Queries must come in increasing order, start <= P < stop.
+  bool maybe_admissable(int64 P);
+};
+
 #endif
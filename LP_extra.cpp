@@ -53,7 +53,7 @@ void LargePreproduct::cars5_threaded(string cars_file, long thread, long num_thr
     do{
       // check threading
       // only do the p3 work if correct thread
-      if(num_admissable % num_threads == thread){
+      if(owns_prefix(num_admissable, thread, num_threads)){
 
       //update L2
       L2 = L1 * (p2 - 1);
@@ -210,7 +210,7 @@ void LargePreproduct::cars5_threaded_modified(string cars_file, long thread, lon
     do{
       // check threading
       // only do the p3 work if correct thread
-      if(num_admissable % num_threads == thread){
+      if(owns_prefix(num_admissable, thread, num_threads)){
 
       //update L2
       L2 = L1 * (p2 - 1);
@@ -356,7 +356,7 @@ void LargePreproduct::cars6_threaded(string cars_file, long thread, long num_thr
     do{
       // check threading
       // only do the p3 work if correct thread
-      if(num_admissable % num_threads == thread){
+      if(owns_prefix(num_admissable, thread, num_threads)){
       //cout << "correct thread with num_admissable = " << num_admissable << "\n";
 
       //update L2
@@ -528,7 +528,7 @@ void LargePreproduct::cars6_threaded_modified(string cars_file, long thread, lon
     while( p2 % p1 == 1 ) { p2 = primes[ ++i2 ]; }
     P2 = P1 * p2;
     do{    
-      if(num_admissable % num_threads == thread){
+      if(owns_prefix(num_admissable, thread, num_threads)){
         L2 = L1 * ( ( p2 - 1 ) / gcd( L1, p2 - 1 ) );
         i3 = i2 + 1;
         upper3 = find_upper(B, P2, 4);
@@ -690,7 +690,7 @@ void LargePreproduct::cars7_threaded(string cars_file, long thread, long num_thr
 
           // check threading
           // only do the p5 work if correct thread
-          if(num_admissable % num_threads == thread){
+          if(owns_prefix(num_admissable, thread, num_threads)){
 
           // update L4
           L4 = L3 * (p4 - 1);
@@ -907,7 +907,7 @@ void LargePreproduct::cars7_threaded_modified(string cars_file, long thread, lon
 
           // check threading
           // only do the p5 work if correct thread
-          if(num_admissable % num_threads == thread){
+          if(owns_prefix(num_admissable, thread, num_threads)){
 
           // update L4
           L4 = L3 * (p4 - 1);
@@ -1128,7 +1128,7 @@ void LargePreproduct::cars8_threaded(string cars_file, long thread, long num_thr
 
             // check threading
             // only do the p6 work if correct thread
-            if(num_admissable % num_threads == thread){
+            if(owns_prefix(num_admissable, thread, num_threads)){
 
             // update L5
             L5 = L4 * (p5 - 1);
@@ -1367,7 +1367,7 @@ void LargePreproduct::cars8_threaded_modified(string cars_file, long thread, lon
 
             // check threading
             // only do the p6 work if correct thread
-            if(num_admissable % num_threads == thread){
+            if(owns_prefix(num_admissable, thread, num_threads)){
 
             // update L5
             L5 = L4 * (p5 - 1);
@@ -1610,7 +1610,7 @@ void LargePreproduct::cars9_threaded(string cars_file, long thread, long num_thr
             do{
               // check threading
               // only do the p5 work if correct thread
-              if(num_admissable % num_threads == thread){
+              if(owns_prefix(num_admissable, thread, num_threads)){
 
               // update L6
               L6 = L5 * (p6 - 1);
@@ -1871,7 +1871,7 @@ void LargePreproduct::cars9_threaded_modified(string cars_file, long thread, lon
             do{
               // check threading
               // only do the p5 work if correct thread
-              if(num_admissable % num_threads == thread){
+              if(owns_prefix(num_admissable, thread, num_threads)){
 
               // update L6
               L6 = L5 * (p6 - 1);
@@ -129,6 +129,8 @@ LargePreproduct& LargePreproduct::operator=(const LargePreproduct &other){
   this->max_d = other.max_d;
   this->prime_B = other.prime_B;
   this->small_sieve_steps = other.small_sieve_steps;
+  this->prefix_ranges = other.prefix_ranges;
+  this->time_prefixes = other.time_prefixes;
 
   // copy over the primes array
   this->primes_count = other.primes_count;
@@ -149,6 +151,8 @@ LargePreproduct::LargePreproduct(const LargePreproduct &other){
   max_d = other.max_d;
   prime_B = other.prime_B;
   small_sieve_steps = other.small_sieve_steps;
+  prefix_ranges = other.prefix_ranges;
+  time_prefixes = other.time_prefixes;
 
   // copy over the primes array
   primes_count = other.primes_count;
@@ -158,6 +162,38 @@ LargePreproduct::LargePreproduct(const LargePreproduct &other){
   }
 }
 
+bool LargePreproduct::owns_prefix(long count, long thread, long num_threads){
+  if(count >= prefix_total) prefix_total = count + 1;
+
+  bool owned = false;
+  if(prefix_ranges.size() == 0){
+    owned = (count % num_threads == thread);
+  }else{
+    for(long i = 0; i < prefix_ranges.size(); ++i){
+      if(prefix_ranges[i].first <= count && count < prefix_ranges[i].second){
+        owned = true;
+        break;
+      }
+    }
+  }
+
+  if(owned && time_prefixes){
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - prefix_clock_start;
+    prefix_times.push_back(pair<long, double>(count, elapsed.count()));
+  }
+  return owned;
+}
+
+void LargePreproduct::cars_threaded(long d, string cars_file, long thread, long num_threads){
+  if(d == 4) cars4_threaded(cars_file, thread, num_threads);
+  else if(d == 5) cars5_threaded(cars_file, thread, num_threads);
+  else if(d == 6) cars6_threaded(cars_file, thread, num_threads);
+  else if(d == 7) cars7_threaded(cars_file, thread, num_threads);
+  else if(d == 8) cars8_threaded(cars_file, thread, num_threads);
+  else if(d == 9) cars9_threaded(cars_file, thread, num_threads);
+  else cars_rec_threaded(d, cars_file, thread, num_threads);
+}
+
 // helper function.  Given lower bound, find index of the smallest prime larger than the bound
 // Algorithm is binary search.  Return -1 if bound is greater than prime_B (corresponds to prime 2)
 long LargePreproduct::find_index_lower(long bound){
@@ -1246,7 +1282,7 @@ void LargePreproduct::cars_rec_threaded(long d, string cars_file, long thread, l
       do{
 
         // check threading
-        if(num_admissable % num_threads == thread){
+        if(owns_prefix(num_admissable, thread, num_threads)){
           // compute current L3
           L3 = L2 * (p3 - 1);
           g = gcd(L2, p3 - 1);
@@ -1356,7 +1392,7 @@ void LargePreproduct::cars_rec_threaded_modified(long d, string cars_file, long
       do{
 
         // check threading
-        if(num_admissable % num_threads == thread){
+        if(owns_prefix(num_admissable, thread, num_threads)){
           // compute current L3
           L3 = L2 * (p3 - 1);
           g = gcd(L2, p3 - 1);
@@ -1400,7 +1436,7 @@ void LargePreproduct::cars_rec_threaded_modified(long d, string cars_file, long
 // recursive version. This helper function tracks preproduct so far.  k is the factor count for preproduct, 
 // while d is the number of factors in the final carmichael number
 // Also, the vector of primes is actually a vector of indices that point to the corresponding primes
-void LargePreproduct::cars_rec_helper(long d, bigint preprod, vector<long> &pis, bigint L, ofstream& output){
+void LargePreproduct::cars_rec_helper(long d, bigint preprod, vector<long> &pis, bigint L, ostream& output){
 
   // k is the number of factors in the preproduct
   long k = pis.size();
@@ -1441,44 +1477,10 @@ void LargePreproduct::cars_rec_helper(long d, bigint preprod, vector<long> &pis,
     bigint new_L;
     bigint g;
 
-    // lower and upper bounds on current prime
-    long lower_bound, upper_bound; 
-    // current_prime is the prime in the primes array corresponding to index
-    long index;
-    long current_prime;
-
-    // calculate lower and upper bounds
-    // Usually we just use the next prime on the lower end, so no lower bound.  Note can't have d-1 == k
-    // if d-3 == k, P > X means lower bound is X/P, unless we know for sure P * next prime > X already
-    // if d-2 == k, it means q is the current prime and we just use next prime
-    // if preprod is 1, we are at the beginning, so set prime index to 0, which should be 3 
-    if(preprod == 1){
-      index = 0;
-    }else if(d - 2 == k){
-      index = largest_index + 1;
-    }else if(d - 3 == k){
-      if(preprod * largest_prime <= X){
-        index = find_index_lower(X / preprod);
-      }else{
-        index = largest_index + 1;
-      }
-    }else{
-      index = largest_index + 1;
-    }
-
-    // starting prime is then the prime at that index
-    current_prime = primes[index];
-
-    // upper bound is (B / preprod)^( 1 / (d - k) )
-    upper_bound = ceil( pow ( B / preprod, 1.0 / (d - k) ) );
-  
-    //cout << "Upper bound = " << upper_bound << " and lower_bound = " << lower_bound << " and index = " << index << "\n";
- 
-    // check admissability, bump ahead until found
-    while( gcd( current_prime - 1, preprod) != 1){
-      index++;
-      current_prime = primes[index];
-    }
+    // index of the first admissable next prime, and the upper bound
+    long index, upper_bound;
+    next_prime_bounds(d, preprod, pis, index, upper_bound);
+    long current_prime = primes[index];
   
     // now loop.  Continue doing work until upper bound reached
     do{
@@ -1506,3 +1508,135 @@ void LargePreproduct::cars_rec_helper(long d, bigint preprod, vector<long> &pis,
     }while(current_prime < upper_bound);
   }
 }
+
+// First admissable index and upper bound for the next prime after the prefix preprod, whose prime indices 
+// are pis.  Shared by cars_rec_helper and cars_stealing, so the two walk exactly the same tree.
+void LargePreproduct::next_prime_bounds(long d, bigint preprod, vector<long> &pis, long &index, long &upper_bound){
+  long k = pis.size();
+  long largest_index;
+  bigint largest_prime;
+  if(k >= 1){
+    largest_index = pis[k-1];
+    largest_prime = primes[largest_index];
+  }
+
+  // current_prime is the prime in the primes array corresponding to index
+  long current_prime;
+
+  // calculate lower and upper bounds
+  // Usually we just use the next prime on the lower end, so no lower bound.  Note can't have d-1 == k
+  // if d-3 == k, P > X means lower bound is X/P, unless we know for sure P * next prime > X already
+  // if d-2 == k, it means q is the current prime and we just use next prime
+  // if preprod is 1, we are at the beginning, so set prime index to 0, which should be 3 
+  if(preprod == 1){
+    index = 0;
+  }else if(d - 2 == k){
+    index = largest_index + 1;
+  }else if(d - 3 == k){
+    if(preprod * largest_prime <= X){
+      index = find_index_lower(X / preprod);
+    }else{
+      index = largest_index + 1;
+    }
+  }else{
+    index = largest_index + 1;
+  }
+
+  // starting prime is then the prime at that index
+  current_prime = primes[index];
+
+  // upper bound is (B / preprod)^( 1 / (d - k) )
+  upper_bound = ceil( pow ( B / preprod, 1.0 / (d - k) ) );
+
+  // check admissability, bump ahead until found
+  while( gcd( current_prime - 1, preprod) != 1){
+    index++;
+    current_prime = primes[index];
+  }
+}
+
+/* Work-stealing version of cars_rec, run by num_workers threads in this process.
+ * A task is a prefix p1 < p2 < ... of the tree cars_rec_helper walks.  A task with fewer than split_depth 
+ * primes is split into one task per admissable next prime, and any other runs cars_rec_helper on its whole 
+ * subtree.  Children are pushed smallest prime first, so the owner carries on with the small subtrees of 
+ * large primes while thieves take the large subtrees of small primes from the front (see WorkStealing.h).
+ * Unlike the *_threaded functions, no thread walks the tree just to count prefixes it does not own.
+ * Each worker writes to its own buffer, and the buffers go to cars_file one after another, so the lines 
+ * are those of cars_rec but not in the same order.  Each worker also has its own copy of this object, since
+ * inner_loop_work updates the count and hist members, and their counts are added back after the join.
+ */
+void LargePreproduct::cars_stealing(long d, string cars_file, long num_workers, long split_depth){
+  if(num_workers < 1) num_workers = 1;
+  // a prefix of d-2 primes is a pre-product, below that the tree is the loop over q
+  if(split_depth > d - 2) split_depth = d - 2;
+
+  class PrefixTask{
+  public:
+    bigint preprod;
+    bigint L;
+    vector<long> pis;
+  };
+
+  WorkStealing<PrefixTask> pool(num_workers);
+  PrefixTask root;
+  root.preprod = 1;
+  root.L = 1;
+  pool.push(0, root);
+
+  vector<ostringstream> buffers(num_workers);
+  vector<LargePreproduct> contexts(num_workers, *this);
+
+  auto work = [&](long w){
+    PrefixTask task;
+    while(true){
+      if(!pool.pop(w, task)){
+        if(pool.done()) break;
+        this_thread::yield();
+        continue;
+      }
+
+      if(task.pis.size() < split_depth){
+        long index, upper_bound;
+        next_prime_bounds(d, task.preprod, task.pis, index, upper_bound);
+        long current_prime = primes[index];
+        bigint g;
+
+        // same loop as cars_rec_helper, pushing each child rather than recursing
+        do{
+          PrefixTask child;
+          child.pis = task.pis;
+          child.pis.push_back(index);
+          child.preprod = task.preprod * current_prime;
+          child.L = task.L * (current_prime - 1);
+          g = gcd(task.L, current_prime - 1);
+          child.L = child.L / g;
+          pool.push(w, child);
+
+          do{
+            index++;
+            current_prime = primes[index];
+          }while( gcd( current_prime - 1, task.preprod ) != 1 );
+        }while(current_prime < upper_bound);
+      }else{
+        contexts[w].cars_rec_helper(d, task.preprod, task.pis, task.L, buffers[w]);
+      }
+      pool.finish();
+    }
+  };
+
+  vector<thread> workers;
+  for(long w = 0; w < num_workers; ++w) workers.push_back(thread(work, w));
+  for(long w = 0; w < num_workers; ++w) workers[w].join();
+
+  for(long w = 0; w < num_workers; ++w){
+    count1 += contexts[w].count1;  count2 += contexts[w].count2;
+    count3 += contexts[w].count3;  count4 += contexts[w].count4;
+    hist1 += contexts[w].hist1;  hist2 += contexts[w].hist2;
+    hist3 += contexts[w].hist3;  hist4 += contexts[w].hist4;
+  }
+
+  ofstream output;
+  output.open(cars_file);
+  for(long w = 0; w < num_workers; ++w) output << buffers[w].str();
+  output.close();
+}
@@ -10,7 +10,12 @@
 #include <math.h>
 #include "bigint.h"
 #include "functions.h"
+#include "WorkStealing.h"
 #include <fstream>
+#include <sstream>
+#include <vector>
+#include <chrono>
+#include <thread>
 
 using namespace std;
 
@@ -50,6 +55,18 @@ class LargePreproduct{
     long hist3 = 0;
     long hist4 = 0;
 
+    // Which prefixes this job owns.  The threaded functions count admissable prefixes and only do the 
+    // work for a prefix if owns_prefix says so.  With no ranges, that is count = thread mod num_threads.
+    // Otherwise it is count in one of the ranges [first, second), as read from a manifest (see Manifest.h).
+    vector<pair<long, long>> prefix_ranges;
+
+    // If time_prefixes is true, owns_prefix records (count, seconds since prefix_clock_start) as each 
+    // owned prefix starts.  The plan executable uses these to estimate the cost of each prefix.
+    bool time_prefixes = false;
+    vector<pair<long, double>> prefix_times;
+    long prefix_total = 0;    // one more than the largest count seen
+    chrono::steady_clock::time_point prefix_clock_start;
+
   public: 
     // default values are B = 100,001 and X = B^{1/3}
     LargePreproduct();
@@ -92,13 +109,26 @@ class LargePreproduct{
     void cars8_threaded_modified(string cars_file, long thread, long num_threads);
     void cars9_threaded_modified(string cars_file, long thread, long num_threads);
 
+    // calls the threaded function for d prime factors: cars4_threaded to cars9_threaded, then cars_rec_threaded
+    void cars_threaded(long d, string cars_file, long thread, long num_threads);
+
+    // true if this job does the work for the admissable prefix with the given count (see prefix_ranges)
+    bool owns_prefix(long count, long thread, long num_threads);
+
+    // Same Carmichaels as cars_rec, found by num_workers threads that split the prefix tree into tasks down 
+    // to split_depth primes and steal them from each other.  Works for any d >= 4.
+    void cars_stealing(long d, string cars_file, long num_workers, long split_depth = 3);
+
 
   public:
 
     // recursive version. This helper function tracks preproduct so far.  k is the factor count for preproduct, 
     // while d is the number of factors in the final carmichael number.
     // The pis vector stores indices of the primes making up the preproduct
-    void cars_rec_helper(long d, bigint preprod, vector<long> &pis, bigint L, ofstream& file_object);
+    void cars_rec_helper(long d, bigint preprod, vector<long> &pis, bigint L, ostream& output);
+
+    // first admissable index and upper bound for the prime after the prefix with prime indices pis
+    void next_prime_bounds(long d, bigint preprod, vector<long> &pis, long &index, long &upper_bound);
     
     // helper function.  Given lower bound, find index of the smallest prime larger than the bound
     // Algorithm is binary search.  Return 0 if bound is greater than prime_B (corresponds to prime 2)
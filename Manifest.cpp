@@ -0,0 +1,73 @@
+/* Work manifests for array jobs.
+ * Andrew Shallue, part of Tabulating Carmichaels project
+ */
+
+#include "Manifest.h"
+
+using namespace std;
+
+bool Manifest::read(string manifest_file){
+  ifstream input;
+  input.open(manifest_file);
+  if(!input.is_open()){
+    cout << "Error in Manifest::read, could not open " << manifest_file << "\n";
+    return false;
+  }
+
+  string line;
+  while(getline(input, line)){
+    if(line.size() == 0 || line[0] == '#') continue;
+
+    ManifestEntry e;
+    istringstream fields(line);
+    if(fields >> e.task >> e.kind >> e.key >> e.start >> e.stop >> e.cost){
+      entries.push_back(e);
+    }else{
+      cout << "Error in Manifest::read, skipping bad line: " << line << "\n";
+    }
+  }
+  input.close();
+  return true;
+}
+
+void Manifest::write(string manifest_file){
+  ofstream output;
+  output.open(manifest_file);
+  output << "# task kind key start stop cost\n";
+  for(long i = 0; i < entries.size(); ++i){
+    output << entries[i].task << " " << entries[i].kind << " " << entries[i].key << " ";
+    output << entries[i].start << " " << entries[i].stop << " " << entries[i].cost << "\n";
+  }
+  output.close();
+}
+
+void Manifest::add(long task, string kind, long key, int64 start, int64 stop, double cost){
+  ManifestEntry e;
+  e.task = task;  e.kind = kind;  e.key = key;
+  e.start = start;  e.stop = stop;  e.cost = cost;
+  entries.push_back(e);
+}
+
+void Manifest::remove_kind(string kind){
+  vector<ManifestEntry> kept;
+  for(long i = 0; i < entries.size(); ++i){
+    if(entries[i].kind != kind) kept.push_back(entries[i]);
+  }
+  entries.swap(kept);
+}
+
+vector<ManifestEntry> Manifest::for_task(long task, string kind, long key){
+  vector<ManifestEntry> result;
+  for(long i = 0; i < entries.size(); ++i){
+    if(entries[i].task == task && entries[i].kind == kind && entries[i].key == key) result.push_back(entries[i]);
+  }
+  return result;
+}
+
+long Manifest::num_tasks(){
+  long count = 0;
+  for(long i = 0; i < entries.size(); ++i){
+    if(entries[i].task + 1 > count) count = entries[i].task + 1;
+  }
+  return count;
+}
@@ -0,0 +1,63 @@
+/* Work manifests for array jobs.
+ * Andrew Shallue, part of Tabulating Carmichaels project
+ *
+ * The plan executable estimates the cost of the work and writes a manifest, a text file with one line
+ * per piece of work:
+ *     task kind key start stop cost
+ * task is the array job that does the piece, and cost is its estimated cost in arbitrary units.
+ *   kind P:       pre-products start <= P < stop for SmallP_Carmichael.  key is 0.
+ *   kind prefix:  prefix counts start <= count < stop for LargePreproduct with d = key prime factors.
+ *                 The count is the num_admissable counter in the cars*_threaded functions.
+ *   kind p1:      for LargePreproduct with d = key = 4, the primes p1 whose index is start mod stop,
+ *                 i.e. thread start of stop in cars4_threaded.
+ * Lines starting with # are comments.  tabulate and tab_serial take the manifest file and a task number
+ * in place of thread and num_threads, and do only the pieces listed for that task.
+ */
+
+#ifndef MANIFEST_H
+#define MANIFEST_H
+
+#include "int.h"
+#include <vector>
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+
+using namespace std;
+
+class ManifestEntry
+{
+public:
+  long task;
+  string kind;
+  long key;
+  int64 start;
+  int64 stop;
+  double cost;
+};
+
+class Manifest
+{
+public:
+  vector<ManifestEntry> entries;
+
+  // read entries from file, adding them to the end.  Returns false if the file can't be opened.
+  bool read(string manifest_file);
+
+  // write all entries to file
+  void write(string manifest_file);
+
+  void add(long task, string kind, long key, int64 start, int64 stop, double cost);
+
+  // remove all entries of the given kind, so that kind can be planned again
+  void remove_kind(string kind);
+
+  // the entries for one task with the given kind and key, in file order
+  vector<ManifestEntry> for_task(long task, string kind, long key);
+
+  // number of tasks, i.e. one more than the largest task number
+  long num_tasks();
+};
+
+#endif
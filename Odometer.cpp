@@ -230,3 +230,50 @@ void Odometer::create_divisors(long prime_index, long curr_position){
   }
   return;
 };
+
+/* Bounded divisors.  The stored divisors run in mixed radix order with the first prime changing fastest, 
+ * so a depth first search that picks the exponent of the last prime first, then the one before it, and so 
+ * on, visits them in the same order.  Exponents are tried in increasing order, so once the partial product 
+ * times the next prime reaches the bound, no larger exponent at that level can give a divisor below it, 
+ * and the whole branch is cut off.  Likewise a branch is cut off when even the largest exponents for the 
+ * primes left cannot bring the partial product up to lower.  The work is then about the number of divisors 
+ * in the range times the number of primes, rather than the number of all divisors.
+ */
+void Odometer::divisors_between(int64* ps, long* pows, long len, int64 multiple, int64 lower, int64 bound, 
+                                vector<int64>& divs){
+  divs.clear();
+  if(multiple >= bound) return;
+
+  // reach[i] = product of ps[j]^pows[j] for j <= i.  At most the whole number, so it fits.
+  // A number below 2^64 has fewer than 16 distinct primes.
+  int64 reach[64];
+  int64 product = 1;
+  for(long i = 0; i < len; ++i){
+    for(long e = 0; e < pows[i]; ++e) product *= ps[i];
+    reach[i] = product;
+  }
+
+  divisors_between_helper(ps, pows, reach, len - 1, multiple, lower, bound, divs);
+}
+
+void Odometer::divisors_between_helper(int64* ps, long* pows, int64* reach, long prime_index, int64 partial, 
+                                       int64 lower, int64 bound, vector<int64>& divs){
+  // every exponent chosen, partial is a divisor below the bound
+  if(prime_index < 0){
+    if(partial >= lower) divs.push_back(partial);
+    return;
+  }
+
+  // nothing in this branch gets up to lower
+  if(partial * reach[prime_index] < lower) return;
+
+  int64 p = ps[prime_index];
+  int64 value = partial;
+  for(long e = 0; e <= pows[prime_index]; ++e){
+    divisors_between_helper(ps, pows, reach, prime_index - 1, value, lower, bound, divs);
+
+    // stop if this was the last exponent, or value * p would reach the bound
+    if(e == pows[prime_index] || value > (bound - 1) / p) break;
+    value *= p;
+  }
+}
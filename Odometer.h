@@ -11,6 +11,9 @@ goes through them linearly.
 
 Another new addition: can specify a vector of primes, then all divisors must 
 be divisible by the primes in the vector.
+
+Bounded version: divisors_between lists only the divisors in a range, in the same 
+order, without ever forming the ones outside it.
 */
 
 #include <vector>
@@ -78,10 +81,21 @@ class Odometer{
     // return divisor corresponding to div_exp
     int64 get_div();
 
+    // All divisors d of the number with primes ps and exponents pows such that lower <= multiple * d < bound.
+    // divs gets multiple * d for each, in the order the stored divisors of an Odometer built from 
+    // the same input would have them.
+    static void divisors_between(int64* ps, long* pows, long len, int64 multiple, int64 lower, int64 bound, 
+                                 vector<int64>& divs);
+
   private:
     // recursive helper function that calculates divisors
     void create_divisors(long prime_index, long curr_position);
 
+    // recursive helper for divisors_between, choosing exponents from prime_index down to 0.
+    // reach[i] is the largest factor primes 0 through i can contribute.
+    static void divisors_between_helper(int64* ps, long* pows, int64* reach, long prime_index, int64 partial, 
+                                        int64 lower, int64 bound, vector<int64>& divs);
+
 };
 
 #endif
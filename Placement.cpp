@@ -0,0 +1,145 @@
+/* Thread placement and huge-page memory.
+ * Andrew Shallue, part of Tabulating Carmichaels project
+ */
+
+#include "Placement.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <new>
+#include <cstdlib>
+#include <sched.h>
+#include <sys/mman.h>
+
+using namespace std;
+
+static long huge_page_mode = HUGE_PAGES_OFF;
+
+// parse a kernel cpu list such as "0-3,8-11"
+static vector<int> parse_cpulist(string list){
+  vector<int> cpus;
+  istringstream fields(list);
+  string range;
+  while(getline(fields, range, ',')){
+    if(range.size() == 0) continue;
+    size_t dash = range.find('-');
+    int first = atoi(range.substr(0, dash).c_str());
+    int last = (dash == string::npos) ? first : atoi(range.substr(dash + 1).c_str());
+    for(int c = first; c <= last; ++c) cpus.push_back(c);
+  }
+  return cpus;
+}
+
+vector<int> placement_cpus(){
+  cpu_set_t allowed;
+  CPU_ZERO(&allowed);
+  if(sched_getaffinity(0, sizeof(allowed), &allowed) != 0){
+    cout << "Error in placement_cpus, sched_getaffinity failed\n";
+    return vector<int>(1, 0);
+  }
+
+  // allowed CPUs of each node, in the order the kernel lists them
+  vector<vector<int>> nodes;
+  vector<bool> seen(CPU_SETSIZE, false);
+  for(long node = 0; ; ++node){
+    ifstream list_file("/sys/devices/system/node/node" + to_string(node) + "/cpulist");
+    if(!list_file.is_open()) break;
+    string list;
+    getline(list_file, list);
+
+    vector<int> node_cpus;
+    vector<int> listed = parse_cpulist(list);
+    for(long k = 0; k < listed.size(); ++k){
+      int c = listed[k];
+      if(c >= 0 && c < CPU_SETSIZE && CPU_ISSET(c, &allowed) && !seen[c]){
+        node_cpus.push_back(c);
+        seen[c] = true;
+      }
+    }
+    if(node_cpus.size() > 0) nodes.push_back(node_cpus);
+  }
+
+  // anything not under a node (or no NUMA information at all) counts as one more node
+  vector<int> rest;
+  for(int c = 0; c < CPU_SETSIZE; ++c){
+    if(CPU_ISSET(c, &allowed) && !seen[c]) rest.push_back(c);
+  }
+  if(rest.size() > 0) nodes.push_back(rest);
+
+  // take one CPU from each node in turn
+  vector<int> cpus;
+  for(long round = 0; ; ++round){
+    bool any = false;
+    for(long node = 0; node < nodes.size(); ++node){
+      if(round < nodes[node].size()){
+        cpus.push_back(nodes[node][round]);
+        any = true;
+      }
+    }
+    if(!any) break;
+  }
+  if(cpus.size() == 0) cpus.push_back(0);
+  return cpus;
+}
+
+bool pin_to_cpu(int cpu){
+  cpu_set_t mask;
+  CPU_ZERO(&mask);
+  CPU_SET(cpu, &mask);
+  // pid 0 is the calling thread
+  return sched_setaffinity(0, sizeof(mask), &mask) == 0;
+}
+
+bool pin_worker(long w){
+  vector<int> cpus = placement_cpus();
+  int cpu = cpus[w % cpus.size()];
+  if(!pin_to_cpu(cpu)){
+    cout << "Error in pin_worker, could not pin worker " << w << " to cpu " << cpu << "\n";
+    return false;
+  }
+  return true;
+}
+
+void set_huge_pages(long mode){
+  huge_page_mode = mode;
+}
+
+long huge_pages(){
+  return huge_page_mode;
+}
+
+// mapped blocks are whole huge pages, since MAP_HUGETLB needs that and it costs little for the others
+static size_t mapped_length(size_t bytes){
+  return (bytes + huge_page_bytes - 1) / huge_page_bytes * huge_page_bytes;
+}
+
+void* big_alloc(size_t bytes){
+  if(bytes < huge_page_bytes){
+    void* p = malloc(bytes > 0 ? bytes : 1);
+    if(p == nullptr) throw bad_alloc();
+    return p;
+  }
+
+  size_t length = mapped_length(bytes);
+  void* p = MAP_FAILED;
+  if(huge_page_mode == HUGE_PAGES_EXPLICIT){
+    p = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  }
+  if(p == MAP_FAILED){
+    p = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(p == MAP_FAILED) throw bad_alloc();
+    // nothing is touched yet, so the pages will come from the node of whichever thread fills them
+    if(huge_page_mode != HUGE_PAGES_OFF) madvise(p, length, MADV_HUGEPAGE);
+  }
+  return p;
+}
+
+void big_free(void* p, size_t bytes){
+  if(p == nullptr) return;
+  if(bytes < huge_page_bytes){
+    free(p);
+    return;
+  }
+  munmap(p, mapped_length(bytes));
+}
@@ -0,0 +1,79 @@
+/* Thread placement and huge-page memory for the threaded and multi-process tabulations.
+ * Andrew Shallue, part of Tabulating Carmichaels project
+ *
+ * On a machine with several NUMA nodes, a worker whose sieves sit in another node's memory pays for it on
+ * every access.  Linux puts a page on the node of the thread that first writes it, so a worker pinned to a
+ * CPU before it builds its context (its Factgen rolls, FD block sieve, Odometer arrays) gets all of that in
+ * local memory, without libnuma.  placement_cpus orders the CPUs this process may use so that consecutive
+ * workers go to different nodes in turn, and within a node in the kernel's order, which lists one thread
+ * of each core before the hyperthread siblings.
+ *
+ * The roll of the incremental sieve is read and written at scattered positions, so for large rolls the TLB
+ * misses add up.  big_alloc serves allocations of at least huge_page_bytes with mmap, and depending on the
+ * huge page mode asks for them to be backed by huge pages:
+ *   HUGE_PAGES_OFF          plain pages
+ *   HUGE_PAGES_TRANSPARENT  madvise(MADV_HUGEPAGE), for transparent huge pages set to "madvise" or "always"
+ *   HUGE_PAGES_EXPLICIT     MAP_HUGETLB from the pool reserved in /proc/sys/vm/nr_hugepages, falling back
+ *                           to transparent huge pages when the pool is empty
+ * Smaller allocations come from malloc.  Which of the two served a block depends only on its size, so
+ * big_free must be given the same size that was passed to big_alloc.
+ *
+ * Sieve tables that grow with the input are big_vectors, i.e. vectors whose storage comes from big_alloc:
+ * the FactgenBlock factor and offset arrays, the AdmissableSieve tables, and the BacktrackPreproducts
+ * smallest prime factor table.
+ */
+
+#ifndef PLACEMENT_H
+#define PLACEMENT_H
+
+#include <vector>
+#include <cstddef>
+
+using namespace std;
+
+const long HUGE_PAGES_OFF = 0;
+const long HUGE_PAGES_TRANSPARENT = 1;
+const long HUGE_PAGES_EXPLICIT = 2;
+
+const size_t huge_page_bytes = 2 * 1024 * 1024;
+
+// CPUs this process is allowed to run on, alternating between NUMA nodes
+vector<int> placement_cpus();
+
+// pin the calling thread (or process) to one CPU.  Returns false if the kernel refuses.
+bool pin_to_cpu(int cpu);
+
+// pin the calling thread to the CPU for worker w, i.e. entry w of placement_cpus, wrapping around
+bool pin_worker(long w);
+
+// huge page mode for big_alloc, for the whole process.  Default HUGE_PAGES_OFF.
+void set_huge_pages(long mode);
+long huge_pages();
+
+// allocate and free memory that may be backed by huge pages.  Never returns nullptr.
+void* big_alloc(size_t bytes);
+void big_free(void* p, size_t bytes);
+
+// allocator for vectors through big_alloc.  Stateless, so any two compare equal.
+template <class T>
+class BigAllocator
+{
+public:
+  typedef T value_type;
+
+  BigAllocator() {}
+  template <class U> BigAllocator(const BigAllocator<U>&) {}
+
+  T* allocate(size_t n) { return static_cast<T*>(big_alloc(n * sizeof(T))); }
+  void deallocate(T* p, size_t n) { big_free(p, n * sizeof(T)); }
+};
+
+template <class T, class U>
+bool operator==(const BigAllocator<T>&, const BigAllocator<U>&) { return true; }
+template <class T, class U>
+bool operator!=(const BigAllocator<T>&, const BigAllocator<U>&) { return false; }
+
+template <class T>
+using big_vector = vector<T, BigAllocator<T> >;
+
+#endif
@@ -11,6 +11,7 @@ Preproduct::Preproduct(){
   Pprimes = nullptr;
   Pprimes_len = 0;
   Pminus = nullptr;
+  Pminus_exps = nullptr;
   Pminus_len = 0;
   L = 0;
   Tau = 0;
@@ -27,6 +28,7 @@ Preproduct::Preproduct(int64 Pval, int64* Pfac, long Pfac_len, int64* PMfac, lon
   Pminus_len  = PMfac_len;
   Pprimes = new int64[Pprimes_len];
   Pminus  = new int64[Pminus_len];
+  Pminus_exps = new long[Pminus_len];
 
   // copy over the factors for both P and P-1
   // In the loop for P, also compute L = lcm_{p | P}(p-1) and P
@@ -59,6 +61,7 @@ Preproduct::Preproduct(int64 Pval, int64* Pfac, long Pfac_len, int64* PMfac, lon
       exp_count++;
       Pminus_prod /= Pminus[i];
     }
+    Pminus_exps[i] = exp_count;
     div_count *= (exp_count + 1);
   }
   Tau = div_count;
@@ -68,6 +71,41 @@ Preproduct::Preproduct(int64 Pval, int64* Pfac, long Pfac_len, int64* PMfac, lon
 
 }
 
+// Same as above, but the exponents of P-1 are given, so Tau needs no division
+Preproduct::Preproduct(int64 Pval, int64* Pfac, long Pfac_len, int64* PMfac, long* PMexps, long PMfac_len){
+  // set length variables, then allocate memory for factor arrays
+  Prod = Pval;
+  Pprimes_len = Pfac_len;
+  Pminus_len  = PMfac_len;
+  Pprimes = new int64[Pprimes_len];
+  Pminus  = new int64[Pminus_len];
+  Pminus_exps = new long[Pminus_len];
+
+  // copy over the factors of P, computing L = lcm_{p | P}(p-1) along the way
+  L = 1;
+  int64 g;
+  int64 prime;
+
+  for(long i = 0; i < Pprimes_len; ++i){
+    Pprimes[i] = Pfac[i];
+    prime = Pprimes[i];
+
+    g = gcd(prime - 1, L);
+    L = L * (prime - 1) / g;
+  }
+
+  // copy over the factors of P-1 and their exponents.  Tau is the product of (e + 1)
+  Tau = 1;
+  for(long i = 0; i < Pminus_len; ++i){
+    Pminus[i] = PMfac[i];
+    Pminus_exps[i] = PMexps[i];
+    Tau *= (Pminus_exps[i] + 1);
+  }
+
+  // set admissable bool by calling is_admissable
+  admissable = is_admissable();
+}
+
 // For the large preproduct case, we don't necessarily have factorization of P-1.
 // So this constructor only populates Pprimes, and only computes L
 Preproduct::Preproduct(bigint Pval, int64* Pfac, long Pfac_len){
@@ -78,6 +116,7 @@ Preproduct::Preproduct(bigint Pval, int64* Pfac, long Pfac_len){
   Pminus_len  = 0;
   Pprimes = new int64[Pprimes_len];
   Pminus  = nullptr;
+  Pminus_exps = nullptr;
 
   // copy over the factors for both P and P-1
   // In the loop for P, also compute L = lcm_{p | P}(p-1) and P
@@ -107,6 +146,7 @@ Preproduct::Preproduct(bigint Pval, int64* Pfac, long Pfac_len){
 Preproduct::~Preproduct(){
   delete[] Pprimes;
   delete[] Pminus;
+  delete[] Pminus_exps;
 }
 
 // copy constructor
@@ -127,6 +167,16 @@ Preproduct::Preproduct(const Preproduct& other){
   for(long i = 0; i < Pminus_len; ++i){
     Pminus[i] = other.Pminus[i];
   }
+
+  // the large case constructor leaves Pminus_exps empty
+  if(other.Pminus_exps != nullptr){
+    Pminus_exps = new long[Pminus_len];
+    for(long i = 0; i < Pminus_len; ++i){
+      Pminus_exps[i] = other.Pminus_exps[i];
+    }
+  }else{
+    Pminus_exps = nullptr;
+  }
 }
 
 // copy assignment operator
@@ -150,6 +200,12 @@ Preproduct Preproduct::operator=(const Preproduct& other){
   for(long i = 0; i < result.Pminus_len; ++i){
     result.Pminus[i] = other.Pminus[i];
   }
+  if(other.Pminus_exps != nullptr){
+    result.Pminus_exps = new long[result.Pminus_len];
+    for(long i = 0; i < result.Pminus_len; ++i){
+      result.Pminus_exps[i] = other.Pminus_exps[i];
+    }
+  }
 
   return result;
 }
@@ -250,6 +306,42 @@ long Preproduct::q_factorization(int64 q, int64* PplusD, long PplusD_len, int64*
   return q_primes_len;
 }
 
+// Merge the primes of P-1 and P+D, adding exponents for primes in both, then divide by 2.
+// Both lists are in increasing order, so 2 ends up in position 0.  P is odd, so 2 | P-1 and is always there.
+long Preproduct::q_factorization(int64* PplusD, long* PplusD_exps, long PplusD_len, int64* q_primes, long* q_exps){
+  long i = 0;
+  long j = 0;
+  long len = 0;
+
+  while(i < Pminus_len && j < PplusD_len){
+    if(Pminus[i] < PplusD[j]){
+      q_primes[len] = Pminus[i];  q_exps[len] = Pminus_exps[i];  i++;
+    }else if(PplusD[j] < Pminus[i]){
+      q_primes[len] = PplusD[j];  q_exps[len] = PplusD_exps[j];  j++;
+    }else{
+      q_primes[len] = Pminus[i];  q_exps[len] = Pminus_exps[i] + PplusD_exps[j];  i++;  j++;
+    }
+    len++;
+  }
+  while(i < Pminus_len){
+    q_primes[len] = Pminus[i];  q_exps[len] = Pminus_exps[i];  i++;  len++;
+  }
+  while(j < PplusD_len){
+    q_primes[len] = PplusD[j];  q_exps[len] = PplusD_exps[j];  j++;  len++;
+  }
+
+  // divide by 2.  If that leaves exponent 0, shift everything down by one
+  q_exps[0]--;
+  if(q_exps[0] == 0){
+    for(long k = 1; k < len; ++k){
+      q_primes[k - 1] = q_primes[k];
+      q_exps[k - 1] = q_exps[k];
+    }
+    len--;
+  }
+  return len;
+}
+
 // return the largest prime dividing the preproduct.  Recall they are stored in increasing order.
 int64 Preproduct::largest_prime(){
   // the last and largest prime is at position Pprimes_len - 1
@@ -18,7 +18,8 @@ class Preproduct{
     // data members
     int64* Pprimes;     // the primes dividing the preproduct
     long   Pprimes_len; // the number of prime factors of P
-    int64* Pminus;      // 
+    int64* Pminus;      // the unique primes dividing P-1
+    long*  Pminus_exps; // their exponents in P-1
     long   Pminus_len;
     int64 L;            // will hold lcm_{p | P} (p-1)
     int64 Tau;          // The divisor count of P-1
@@ -32,6 +33,10 @@ class Preproduct{
     // The constructor also calculates L and Tau.
     Preproduct(int64 Pval, int64* Pfac, long Pfac_len, int64* PMfac, long PMfac_len);
 
+    // Same, but the exponents of the primes dividing P-1 are given too (e.g. from Factgen2), 
+    // so Tau is computed without dividing P-1 again.
+    Preproduct(int64 Pval, int64* Pfac, long Pfac_len, int64* PMfac, long* PMexps, long PMfac_len);
+
     // For the large preproduct case, we don't necessarily have factorization of P-1.
     // So this constructor only populates Pprimes, and only computes L
     Preproduct(bigint Pval, int64* Pfac, long Pfac_len);
@@ -49,6 +54,10 @@ class Preproduct{
     // All arrays are passed by reference.  Return value is the length of the q_primes, q_exps arrays.
     long q_factorization(int64 q, int64* PplusD, long PplusD_len, int64* q_primes, long* q_exps);
 
+    // Same, but from the primes and exponents of P+D.  The exponent vectors of P-1 and P+D are merged 
+    // and the exponent of 2 is reduced by one, so no division of q is needed.
+    long q_factorization(int64* PplusD, long* PplusD_exps, long PplusD_len, int64* q_primes, long* q_exps);
+
     // return the largest prime dividing the preproduct.  Recall they are stored in increasing order.
     int64 largest_prime();
 
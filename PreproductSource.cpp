@@ -0,0 +1,174 @@
+/* Sources of pre-products for SmallP_Carmichael.
+ * Andrew Shallue, part of Tabulating Carmichaels project
+ */
+
+#include "PreproductSource.h"
+
+using namespace std;
+
+/******************* SievePreproducts *****************/
+
+void SievePreproducts::init(int64 startint, int64 stopint){
+  int64 start_P = (startint % 2 == 0) ? startint + 1 : startint;
+  stop = stopint;
+
+  // F starts with current equal to start_P
+  F.init(start_P - 1, stop);
+  A.init(start_P, stop);
+  started = false;
+}
+
+bool SievePreproducts::next(){
+  while(true){
+    if(started){
+      F.next_odd();
+    }
+    started = true;
+
+    P = F.currentval;
+    if(P >= stop) return false;
+
+    // hand out P only if the admissability sieve has not crossed it off
+    if(A.maybe_admissable(P)){
+      Pprimes = F.current;
+      Pprimes_len = F.currentlen;
+      Pminus = F.prev;
+      Pminus_exps = F.prevexp;
+      Pminus_len = F.prevlen;
+      return true;
+    }
+  }
+}
+
+/******************* BacktrackPreproducts *****************/
+
+BacktrackPreproducts::BacktrackPreproducts(){
+  table_bound = 0;
+  stop = 0;
+  chunk_len = 1048576;
+  lo = 0;
+  hi = 0;
+  found_pos = 0;
+  P = 0;
+  Pprimes = Pprimes_buf;
+  Pprimes_len = 0;
+  Pminus = Pminus_buf;
+  Pminus_exps = Pminus_exps_buf;
+  Pminus_len = 0;
+}
+
+// sieve of Eratosthenes over odd n, recording the first prime to cross off each n
+void BacktrackPreproducts::build_tables(int64 bound){
+  table_bound = bound;
+  spf.assign(bound / 2 + 1, 0);
+  odd_primes.clear();
+
+  for(int64 p = 3; p < bound; p += 2){
+    if(spf[p / 2] != 0) continue;
+    odd_primes.push_back(p);
+
+    // odd multiples of p from p^2 on.  Only primes below 2^16 cross anything off when bound <= 2^32.
+    if(p > (bound - 1) / p) continue;
+    for(int64 j = p * p; j < bound; j += 2 * p){
+      if(spf[j / 2] == 0) spf[j / 2] = p;
+    }
+  }
+}
+
+void BacktrackPreproducts::init(int64 startint, int64 stopint){
+  stop = stopint;
+  lo = (startint % 2 == 0) ? startint + 1 : startint;
+  hi = lo;
+  found.clear();
+  found_pos = 0;
+
+  // the tables only need rebuilding if they are too small
+  if(stop > table_bound) build_tables(stop);
+}
+
+// Extend m by each prime p larger than its largest prime, provided no prime of m divides p - 1
+void BacktrackPreproducts::search(int64 m, long q_index, int64* mprimes, long mlen){
+  long num_primes = odd_primes.size();
+  long first = q_index + 1;
+
+  // children m p in [lo, hi).  Start at the first prime with m p >= lo.
+  int64 p_low = (lo + m - 1) / m;
+  long i = lower_bound(odd_primes.begin(), odd_primes.end(), p_low) - odd_primes.begin();
+  if(i < first) i = first;
+
+  int64 p_high = (hi - 1) / m;
+  for(; i < num_primes && odd_primes[i] <= p_high; ++i){
+    int64 p = odd_primes[i];
+    bool coprime = true;
+    for(long k = 0; k < mlen; ++k){
+      if((p - 1) % mprimes[k] == 0){ coprime = false; break; }
+    }
+    if(coprime) found.push_back(m * p);
+  }
+
+  // children m p that leave room for a larger prime p', i.e. m p p' < hi, so m p <= (hi - 1) / p
+  for(i = first; i < num_primes && m * odd_primes[i] <= (hi - 1) / odd_primes[i]; ++i){
+    int64 p = odd_primes[i];
+    bool coprime = true;
+    for(long k = 0; k < mlen; ++k){
+      if((p - 1) % mprimes[k] == 0){ coprime = false; break; }
+    }
+    if(coprime){
+      mprimes[mlen] = p;
+      search(m * p, i, mprimes, mlen + 1);
+    }
+  }
+}
+
+void BacktrackPreproducts::fill_chunk(){
+  found.clear();
+  found_pos = 0;
+
+  int64 mprimes[20];
+  search(1, -1, mprimes, 0);
+
+  sort(found.begin(), found.end());
+}
+
+// divide out smallest prime factors using the table.  A table entry of 0 means what remains is prime.
+long BacktrackPreproducts::factor_odd(int64 n, int64* primes_out, long* exps_out, long len){
+  while(n > 1){
+    int64 p = spf[n / 2];
+    if(p == 0) p = n;
+
+    primes_out[len] = p;
+    exps_out[len] = 0;
+    while(n % p == 0){
+      n = n / p;
+      exps_out[len]++;
+    }
+    len++;
+  }
+  return len;
+}
+
+bool BacktrackPreproducts::next(){
+  // move on to the next chunk with a pre-product in it
+  while(found_pos == found.size()){
+    if(hi >= stop) return false;
+    lo = hi;
+    hi = (lo + chunk_len < stop) ? lo + chunk_len : stop;
+    fill_chunk();
+  }
+
+  P = found[found_pos];
+  found_pos++;
+
+  // P is squarefree, so the exponents are not kept
+  long P_exps[20];
+  Pprimes_len = factor_odd(P, Pprimes_buf, P_exps, 0);
+
+  // P-1 is even.  The power of 2 comes from the trailing zeros, the rest from the table.
+  int64 Pm = P - 1;
+  long twos = __builtin_ctzll(Pm);
+  Pminus_buf[0] = 2;
+  Pminus_exps_buf[0] = twos;
+  Pminus_len = factor_odd(Pm >> twos, Pminus_buf, Pminus_exps_buf, 1);
+
+  return true;
+}
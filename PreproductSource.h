@@ -0,0 +1,109 @@
+/* Sources of pre-products for SmallP_Carmichael.
+ * Andrew Shallue, part of Tabulating Carmichaels project
+ *
+ * A source hands out odd pre-products P in increasing order, together with the primes dividing P
+ * and the primes and exponents of P-1, which is what the Preproduct constructor needs.
+ * SmallP_Carmichael::tabulate_car_source takes any source, so the two ways of producing pre-products
+ * can be timed against each other on the same tabulation.
+ *
+ * SievePreproducts: the incremental sieve.  Every odd P is factored by Factgen2, and the AdmissableSieve
+ *   passes over most of the inadmissable ones.  Some P handed out may still be inadmissable.
+ * BacktrackPreproducts: Pinch's approach.  Admissable P are built as products of increasing primes,
+ *   so inadmissable P are never visited.  P-1 is factored with a smallest prime factor table.
+ *
+ * Assumes P < 2^32, as elsewhere in SmallP_Carmichael.
+ */
+
+#ifndef PREPRODUCTSOURCE_H
+#define PREPRODUCTSOURCE_H
+
+#include "int.h"
+#include "Factgen.h"
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+
+class PreproductSource
+{
+public:
+  // the current pre-product, its unique primes, and the unique primes of P-1 with exponents
+  int64  P;
+  int64* Pprimes;
+  long   Pprimes_len;
+  int64* Pminus;
+  long*  Pminus_exps;
+  long   Pminus_len;
+
+  virtual ~PreproductSource() {}
+
+  // pre-products will be the odd P with startint <= P < stopint.  Assumes startint >= 3.
+  virtual void init(int64 startint, int64 stopint) = 0;
+
+  // move to the next pre-product.  Returns false once there are none left.
+  virtual bool next() = 0;
+};
+
+// Pre-products from the incremental sieve, as tabulate_car has always done it
+class SievePreproducts : public PreproductSource
+{
+private:
+  Factgen2 F;           // factorizations of P and P-1
+  AdmissableSieve A;    // skips most inadmissable P
+  int64 stop;
+  bool started;         // false until the first call to next
+
+public:
+  void init(int64 startint, int64 stopint);
+  bool next();
+};
+
+/* Pre-products from a backtracking search over products of odd primes, as in Pinch.
+ * Writing P = m p with p the largest prime, P is admissable iff m is admissable and no prime of m divides p-1.
+ * So the search extends admissable m by primes p larger than those in m, and only tests p-1 against
+ * the primes of m.  The search runs over one chunk [lo, hi) of pre-products at a time.  A node m is
+ * expanded further only if m p p' < hi is possible, and its children m p inside the chunk are
+ * found by binary search in the primes list, so the work per chunk is close to the number of outputs.
+ * The pre-products of a chunk are sorted before they are handed out.
+ *
+ * Memory: the smallest prime factor table holds a 16-bit entry for each odd n < stop, and the primes
+ * list holds every odd prime below stop.
+ */
+class BacktrackPreproducts : public PreproductSource
+{
+private:
+  big_vector<uint16_t> spf;      // spf[n/2] is the smallest prime factor of odd n, or 0 if n is 1 or prime
+  big_vector<int64> odd_primes;  // odd primes below table_bound
+  int64 table_bound;         // spf and odd_primes cover n < table_bound
+
+  int64 stop;
+  int64 chunk_len;           // pre-products in [lo, lo + chunk_len) are found together
+  int64 lo, hi;              // current chunk
+  vector<int64> found;       // admissable P in the current chunk, increasing
+  long found_pos;
+
+  // storage for the arrays handed out
+  int64 Pprimes_buf[20];
+  int64 Pminus_buf[20];
+  long  Pminus_exps_buf[20];
+
+  // build spf and odd_primes for all n < bound
+  void build_tables(int64 bound);
+
+  // extend the admissable product m, whose primes are mprimes[0..mlen-1] with the largest at index q_index
+  void search(int64 m, long q_index, int64* mprimes, long mlen);
+
+  // find and sort the admissable P in [lo, hi)
+  void fill_chunk();
+
+  // write the unique primes and exponents of odd n into primes_out, exps_out, starting at index len
+  long factor_odd(int64 n, int64* primes_out, long* exps_out, long len);
+
+public:
+  BacktrackPreproducts();
+
+  void init(int64 startint, int64 stopint);
+  bool next();
+};
+
+#endif
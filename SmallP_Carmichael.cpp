@@ -33,9 +33,9 @@ SmallP_Carmichael::SmallP_Carmichael(){
   F = Factgen2();
   F.init(2, B_upper);
 
-  // create Factgen object for P+D
+  // create FactgenBlock object for P+D
   // don't initialize now, need to do so later
-  FD = Factgen();
+  FD = FactgenBlock();
 
   // set q, r to 0.  initialize the mpz variables
   q = 0;  r = 0;  q_D = 0;
@@ -59,6 +59,15 @@ SmallP_Carmichael::SmallP_Carmichael(){
   }
   res_P_index = 0;
   res_D_index = 0;
+
+  crossover_batch = 64;
+  crossover_threads = 1;
+  pin_workers = false;
+  residue_divisor_min = 512;
+  incremental_CD = true;
+  block_CD = true;
+  defer_primality = false;
+  checkpoint_seconds = 600;
 }
 
 // set preproduct bound B to given value.  Initialize F.  FD gets initialized in a separate function.
@@ -71,7 +80,7 @@ SmallP_Carmichael::SmallP_Carmichael(int64 B_low_val, int64 B_up_val, bigint X_v
 
   F = Factgen2();
   F.init(B_lower - 1, B_upper);
-  FD = Factgen();
+  FD = FactgenBlock();
 
   q = 0;  r = 0;  q_D = 0;
   mpz_init(q_mpz);  mpz_init(r_mpz);
@@ -94,6 +103,15 @@ SmallP_Carmichael::SmallP_Carmichael(int64 B_low_val, int64 B_up_val, bigint X_v
   }
   res_P_index = 0;
   res_D_index = 0;
+
+  crossover_batch = 64;
+  crossover_threads = 1;
+  pin_workers = false;
+  residue_divisor_min = 512;
+  incremental_CD = true;
+  block_CD = true;
+  defer_primality = false;
+  checkpoint_seconds = 600;
 }
 
 //destructor is here to clear the mpz_t variables, everything else can be cleared using default methods
@@ -108,6 +126,7 @@ SmallP_Carmichael::SmallP_Carmichael(const SmallP_Carmichael& other){
   // first copy over factgen objects and bounds
   F = other.F;
   FD = other.FD;
+  A = other.A;
   B_upper = other.B_upper;
   B_lower = other.B_lower;
   q = other.q;
@@ -134,6 +153,12 @@ SmallP_Carmichael::SmallP_Carmichael(const SmallP_Carmichael& other){
   res_D_index = other.res_D_index;
   total_residue = other.total_residue;
   num_residues = other.num_residues;
+  copy_tuning(other);
+  crossover_threads = other.crossover_threads;
+  pin_workers = other.pin_workers;
+  defer_primality = other.defer_primality;
+  checkpoint_file = other.checkpoint_file;
+  checkpoint_seconds = other.checkpoint_seconds;
 }
 
 // operator= is very similar to copy constructor
@@ -142,6 +167,7 @@ SmallP_Carmichael SmallP_Carmichael::operator=(const SmallP_Carmichael& other){
   SmallP_Carmichael result_ob;
   result_ob.F = other.F;
   result_ob.FD = other.FD;
+  result_ob.A = other.A;
   result_ob.B_upper = other.B_upper;
   result_ob.B_lower = other.B_lower;
   result_ob.q = other.q;
@@ -168,10 +194,25 @@ SmallP_Carmichael SmallP_Carmichael::operator=(const SmallP_Carmichael& other){
   result_ob.res_D_index = other.res_D_index;
   result_ob.total_residue = other.total_residue; 
   result_ob.num_residues = other.num_residues; 
+  result_ob.copy_tuning(other);
+  result_ob.crossover_threads = other.crossover_threads;
+  result_ob.pin_workers = other.pin_workers;
+  result_ob.defer_primality = other.defer_primality;
+  result_ob.checkpoint_file = other.checkpoint_file;
+  result_ob.checkpoint_seconds = other.checkpoint_seconds;
 
   return result_ob;
 }
 
+// The settings that change how pre-products are worked on but not what is found.  Worker threads build their 
+// own contexts, and copy these from the object that started them.
+void SmallP_Carmichael::copy_tuning(const SmallP_Carmichael& other){
+  crossover_batch = other.crossover_batch;
+  residue_divisor_min = other.residue_divisor_min;
+  incremental_CD = other.incremental_CD;
+  block_CD = other.block_CD;
+}
+
 // Historical note: when this class was Construct_car, it had an admissable function.
 // That function now in the Preproduct class
 
@@ -240,8 +281,9 @@ void SmallP_Carmichael::tabulate_all_DDelta(string cars_file){
   ofstream output;
   output.open(cars_file);
 
-  // initialize the Factgen2 object that stores factorizations of P, P-1
+  // initialize the Factgen2 object that stores factorizations of P, P-1, and the admissability sieve
   F.init(2, B_upper);
+  A.init(3, B_upper);
 
   // count the number of admissable pre-products
   int64 num_admissable = 0;
@@ -261,8 +303,16 @@ void SmallP_Carmichael::tabulate_all_DDelta(string cars_file){
     Pminus_factors = F.prev;
     Pminus_factors_len = F.prevlen;
 
+    // skip pre-products crossed off by the admissability sieve, without building a Preproduct
+    if(!A.maybe_admissable(P)){
+      F.next_odd();
+      res_P_index += 2;
+      if(res_P_index > total_residue) res_P_index -= total_residue;
+      continue;
+    }
+
     // construct Preproduct object
-    Preproduct P_ob = Preproduct(P, P_factors, P_factors_len, Pminus_factors, Pminus_factors_len);
+    Preproduct P_ob = Preproduct(P, P_factors, P_factors_len, Pminus_factors, F.prevexp, Pminus_factors_len);
 
       // if admissable, construct Carmichaels
       if(P_ob.admissable){
@@ -283,8 +333,7 @@ void SmallP_Carmichael::tabulate_all_DDelta(string cars_file){
         } // end for
       } // end if admissable
       // move the factorization window to next odd number
-      F.next();
-      F.next();
+      F.next_odd();
 
       // update the P index
       res_P_index += 2;
@@ -308,8 +357,9 @@ void SmallP_Carmichael::tabulate_all_CD(string cars_file){
   ofstream output;
   output.open(cars_file);
 
-  // initialize the Factgen2 object that stores factorizations of P, P-1
+  // initialize the Factgen2 object that stores factorizations of P, P-1, and the admissability sieve
   F.init(2, B_upper);
+  A.init(3, B_upper);
 
   // count the number of admissable pre-products
   int64 num_admissable = 0;
@@ -326,8 +376,14 @@ void SmallP_Carmichael::tabulate_all_CD(string cars_file){
     Pminus_factors = F.prev;
     Pminus_factors_len = F.prevlen;
 
+    // skip pre-products crossed off by the admissability sieve, without building a Preproduct
+    if(!A.maybe_admissable(P)){
+      F.next_odd();
+      continue;
+    }
+
     // construct Preproduct object
-    Preproduct P_ob = Preproduct(P, P_factors, P_factors_len, Pminus_factors, Pminus_factors_len);
+    Preproduct P_ob = Preproduct(P, P_factors, P_factors_len, Pminus_factors, F.prevexp, Pminus_factors_len);
 
       // if admissable, construct Carmichaels
       if(P_ob.admissable){
@@ -348,8 +404,7 @@ void SmallP_Carmichael::tabulate_all_CD(string cars_file){
         } // end for
       } // end if admissable
       // move the factorization window to next odd number
-      F.next();
-      F.next();
+      F.next_odd();
 
   } // end for P 
 
@@ -369,29 +424,43 @@ void SmallP_Carmichael::DDelta(Preproduct& P, bigint D, libdivide::divider<int64
     //cout << "Inside DDelta with P = " << P.Prod << " and D = " << D << "\n";
 
     int64 Delta_bound;  // stores upper bound on Delta to ensure it isn't too big (making q too small)
-    int64 div = 1;      // will store divisors of (P-1)(P+D)/2    
+    int64 Delta_min;    // lower bound on Delta, see Delta_lower
     int64 divisor_multiple = 1;  // primes that all Odomter divs must include
 
     // We set up an odometer, which requires primes and powers
     // Note this is not the final value of q, just the one needed to compute divisors.
     q_D = (P.Prod - 1) * (P.Prod + D) / 2;
-    int64 qtemp = q_D;   
+
+    // P_minus has the unique prime factors dividing P-1, along with their exponents.
+    // FD.prev has the same for P+D
+    int64* PplusD = FD.prev;
+    long* PplusD_exps = FD.prevexp;
+    long PplusD_len = FD.prevlen;   
  
+    // from PplusD and Pminus, compute full factorization of q_D (see Preproduct class).
+    // Update: the exponent vectors are merged, so there is no need to divide q_D by each prime
+    int64* q_primes = new int64[PplusD_len + P.Pminus_len];
+    long* q_exps   = new long[PplusD_len + P.Pminus_len];
+    long q_primes_len = P.q_factorization(PplusD, PplusD_exps, PplusD_len, q_primes, q_exps);  
+
     // for each prime tracked, first check if D = 0 mod p
+    // The tracked primes are small, so if they divide q_D they are near the front of q_primes
+    long k;
     for(long i = 0; i < num_residues; ++i){
       if(residues_D[res_D_index][i] == 0){
-        // if P = 0 mod p, then Delta = 0 mod p, so add the prime as a must have
-        // The way this is implemented, we take the prime out of q, then Odometer multiplies by must_divide at end
-        if(residues_P[res_P_index][i] == 0){
-          // of course, this is only done if q_D is divisible by the prime in the first place
-          if(qtemp % primes[i] == 0){
+        k = 0;
+        while(k < q_primes_len && q_primes[k] < primes[i]) k++;
+
+        // of course, this is only done if q_D is divisible by the prime in the first place
+        if(k < q_primes_len && q_primes[k] == primes[i]){
+          // if P = 0 mod p, then Delta = 0 mod p, so add the prime as a must have
+          // The way this is implemented, we take one p out of q, then Odometer multiplies by must_divide at end
+          if(residues_P[res_P_index][i] == 0){
             divisor_multiple *= primes[i];
-            qtemp = qtemp / primes[i];
-          }
-        }else if(residues_P[res_P_index][i] == 1){
-        // if P != 0 mod p, then Delta != 0 mod p, so remove all factors of p from q
-          while(qtemp % primes[i] == 0){
-            qtemp = qtemp / primes[i];
+            q_exps[k]--;
+          }else if(residues_P[res_P_index][i] == 1){
+          // if P != 0 mod p, then Delta != 0 mod p, so remove all factors of p from q
+            q_exps[k] = 0;
           }
         }
       }
@@ -399,51 +468,55 @@ void SmallP_Carmichael::DDelta(Preproduct& P, bigint D, libdivide::divider<int64
 
     } // end for loop over residues
 
-    // P_minus has the unique prime factors dividing P-1.
-    // copy over prev into PplusD
-    int64* PplusD = FD.prev;
-    long PplusD_len = FD.prevlen;   
- 
-    // from PplusD and Pminus, compute full factorization of q_D (see Preproduct class) 
-    int64* q_primes = new int64[PplusD_len + P.Pminus_len];
-    long* q_exps   = new long[PplusD_len + P.Pminus_len];
-    long q_primes_len = P.q_factorization(qtemp, PplusD, PplusD_len, q_primes, q_exps);  
-
-    // Set up odometer to run through divisors of (P-1)(P+D)/2.  true means we are computing 
-    // and storing divisors up front.  Passing false would mean divisors are computed on the fly
-    Odometer q_od = Odometer(q_primes, q_exps, q_primes_len, divisor_multiple, true);
-    div = q_od.get_div();
+    // primes whose exponent dropped to 0 are removed
+    long write_index = 0;
+    for(long read_index = 0; read_index < q_primes_len; ++read_index){
+      if(q_exps[read_index] != 0){
+        q_primes[write_index] = q_primes[read_index];
+        q_exps[write_index] = q_exps[read_index];
+        write_index++;
+      }
+    }
+    q_primes_len = write_index;
 
-    // Run the code for divisor Delta = 1
-    // apply completion check subroutine to see if this divisor Delta creates Carmichael
-    bool some_carmichaels = completion_check(P, div, D, fastD);
-    
-    // now go to next divisor
-    q_od.next_div();
-    div = q_od.get_div();
-    
     // Throw out the divisor if it is too big.  It needs to be small enough so q is bigger than p_{d-2}.
     // The appropriate bound is Delta < (P-1)(P+D)/(p_{d-2}-1)
     // Mult size check: P.Prod is at most 32 bits, so mult will fit in 64 bits, and 64-bit * okay
     Delta_bound = (P.Prod - 1) * (P.Prod + D);
     Delta_bound = Delta_bound / (P.largest_prime() - 1);
-    
-    // continue looking at divisors until it is back to 1
-    while(div != q_od.initial_div){
+    Delta_min = Delta_lower(P, D);
+
+    // with many divisors, enumerate only those in the residue class C integrality allows
+    long num_divisors = 1;
+    for(long i = 0; i < q_primes_len; ++i) num_divisors *= q_exps[i] + 1;
+    if(num_divisors >= residue_divisor_min){
+      DDelta_residue(P, D, fastD, q_primes, q_exps, q_primes_len, divisor_multiple, Delta_min, Delta_bound);
+      delete[] q_primes;
+      delete[] q_exps;
+      return;
+    }
 
-      //testing
-      //if(D == 13) cout << "inside DDelta, div = " << div << " and Delta_bound = " << Delta_bound << "\n";
+    // Run the code for divisor Delta = 1 (times divisor_multiple), which is tried whatever its size 
+    // relative to Delta_bound.  Below Delta_min it cannot give a Carmichael in range.
+    // apply completion check subroutine to see if this divisor Delta creates Carmichael
+    bool some_carmichaels = false;
+    if(divisor_multiple >= Delta_min) some_carmichaels = completion_check(P, divisor_multiple, D, fastD);
 
-      if(div < Delta_bound){
+    // The rest of the divisors of (P-1)(P+D)/2, in Odometer order, but only those in [Delta_min, Delta_bound).
+    // Divisors outside are never formed (see Odometer::divisors_between).
+    Odometer::divisors_between(q_primes, q_exps, q_primes_len, divisor_multiple, Delta_min, Delta_bound, 
+                               bounded_divs);
 
-        // apply completion check subroutine to see if this divisor Delta creates Carmichael
-        some_carmichaels = completion_check(P, div, D, fastD);
-      } // end if div < Delta_bound
-      
-      // next iteration
-      q_od.next_div();
-      div = q_od.get_div();
-    } //end while div != 1
+    // the first one listed may be divisor_multiple itself, which was done above
+    if(bounded_divs.size() > 0 && bounded_divs[0] == divisor_multiple) bounded_divs.erase(bounded_divs.begin());
+
+    // Most divisors fail the integrality of C, so test them all together first
+    filter_C_integral(P.Prod * P.Prod, D, fastD, bounded_divs);
+    for(long k = 0; k < bounded_divs.size(); ++k){
+
+      // apply completion check subroutine to see if this divisor Delta creates Carmichael
+      some_carmichaels = completion_check(P, bounded_divs[k], D, fastD);
+    }
 
     // free memory for q_primes and q_exps before next cycle
     delete[] q_primes;
@@ -451,6 +524,182 @@ void SmallP_Carmichael::DDelta(Preproduct& P, bigint D, libdivide::divider<int64
 
 }
 
+/* The divisors of q_D in DDelta, restricted to those that can pass completion_check.
+ * C = (P^2 + Delta)/D is integral exactly when Delta = -P^2 mod D, and most divisors fail that test.
+ * Rather than run through all Tau of them, split the primes of q_D into two sets, U and T.  Every divisor 
+ * is divisor_multiple * a * b with a made of primes in U and b of primes in T.  U has only primes not 
+ * dividing D, so each a is invertible mod D, and its inverse is built up from inverses of the primes 
+ * alongside a itself.  The values divisor_multiple * b are sorted by residue mod D, and for each a the 
+ * b with divisor_multiple * a * b = -P^2 mod D are one class, found by binary search.  The work is about 
+ * the number of a plus the number of b plus the number of matches, rather than their product.
+ *
+ * Odometer lists divisors in mixed radix order, with the first prime changing fastest, so the Odometer 
+ * position of a divisor is a sum over its primes of exponent times weight.  Matches are checked in order 
+ * of position, which writes the Carmichaels to qrs in the same order DDelta would.
+ */
+void SmallP_Carmichael::DDelta_residue(Preproduct& P, int64 D, libdivide::divider<int64>& fastD, int64* q_primes, 
+                                       long* q_exps, long q_primes_len, int64 divisor_multiple, int64 Delta_min, 
+                                       int64 Delta_bound){
+  // Odometer weight of each prime, and the divisor count
+  vector<long> weight(q_primes_len);
+  long num_divisors = 1;
+  for(long i = 0; i < q_primes_len; ++i){
+    weight[i] = num_divisors;
+    num_divisors *= q_exps[i] + 1;
+  }
+
+  // primes dividing D go to T.  Of the others, U takes primes while it has at most sqrt(Tau) divisors.
+  vector<long> U, T;
+  long U_count = 1;
+  for(long i = 0; i < q_primes_len; ++i){
+    long with_i = U_count * (q_exps[i] + 1);
+    if(D % q_primes[i] != 0 && with_i * with_i <= num_divisors){
+      U.push_back(i);
+      U_count = with_i;
+    }else{
+      T.push_back(i);
+    }
+  }
+
+  // A divisor of the full product is below Delta_bound only if each of its two parts is, so parts at or 
+  // above it are dropped as they are built, along with everything that would have been built from them
+  int64 part_limit = (Delta_bound - 1) / divisor_multiple;
+
+  // divisors made of the primes in side, with their Odometer positions, and inverses mod D if asked for
+  auto side_divisors = [&](vector<long>& side, vector<int64>& divs, vector<long>& positions, vector<int64>* inverses){
+    divs.assign(1, 1);
+    positions.assign(1, 0);
+    if(inverses != nullptr) inverses->assign(1, 1);
+    for(long s = 0; s < side.size(); ++s){
+      long i = side[s];
+      long existing = divs.size();
+      int64 power = 1;
+      int64 power_inv = 1;
+      int64 p_inv = 0, y;
+      if(inverses != nullptr){
+        extgcd(q_primes[i] % D, D, p_inv, y);
+        p_inv %= D;
+        if(p_inv < 0) p_inv += D;
+      }
+      for(long e = 1; e <= q_exps[i]; ++e){
+        power *= q_primes[i];
+        power_inv = power_inv * p_inv % D;
+        for(long j = 0; j < existing; ++j){
+          if(divs[j] * power > part_limit) continue;
+          divs.push_back(divs[j] * power);
+          positions.push_back(positions[j] + e * weight[i]);
+          if(inverses != nullptr) inverses->push_back((*inverses)[j] * power_inv % D);
+        }
+      }
+    }
+  };
+
+  vector<int64> U_divs, U_inverses, T_divs;
+  vector<long> U_positions, T_positions;
+  side_divisors(U, U_divs, U_positions, &U_inverses);
+  side_divisors(T, T_divs, T_positions, nullptr);
+
+  // divisor_multiple * b by residue mod D, keeping each b's index
+  int64 multiple_res = divisor_multiple % D;
+  vector<pair<int64, long>> by_residue(T_divs.size());
+  for(long j = 0; j < T_divs.size(); ++j){
+    by_residue[j] = pair<int64, long>(multiple_res * (T_divs[j] % D) % D, j);
+  }
+  sort(by_residue.begin(), by_residue.end());
+
+  // P^2 fits in 64 bits, see DDelta
+  int64 target = (D - (P.Prod * P.Prod) % D) % D;
+
+  // (Odometer position, divisor) of every match
+  vector<pair<long, int64>> matches;
+  for(long i = 0; i < U_divs.size(); ++i){
+    int64 b_res = target * U_inverses[i] % D;
+    auto it = lower_bound(by_residue.begin(), by_residue.end(), pair<int64, long>(b_res, -1));
+    for(; it != by_residue.end() && it->first == b_res; ++it){
+      long j = it->second;
+      matches.push_back(pair<long, int64>(U_positions[i] + T_positions[j], divisor_multiple * U_divs[i] * T_divs[j]));
+    }
+  }
+  sort(matches.begin(), matches.end());
+
+  // as in DDelta, the first divisor is tried whatever its size relative to Delta_bound and the rest only below it
+  for(long k = 0; k < matches.size(); ++k){
+    if(matches[k].second < Delta_min) continue;
+    if(matches[k].first == 0 || matches[k].second < Delta_bound){
+      completion_check(P, matches[k].second, D, fastD);
+    }
+  }
+}
+
+/* Lower bound on Delta for a given P, D.  q - 1 = (P-1)(P+D)/Delta and r - 1 = (P-1)(P+C)/Delta, with 
+ * C = (P^2 + Delta)/D, both fall as Delta grows, so a bound on the Carmichael gives a least Delta.
+ * r > q does not: it is the same as C > D, and CD = P^2 + Delta > P^2 > D^2 since D < P.
+ * In bounded mode Pqr < X.  As Pqr > P(q-1)(r-1), that needs
+ *     P (P-1)^2 (P+D) (P(P+D) + Delta) < X D Delta^2,
+ * so Delta is above the positive root of the quadratic.  The terms go past 2^128, so the root is computed 
+ * in long double and rounded down with some slack, so that no Delta that could pass is cut.
+ * Returns 1, i.e. no bound, when not in bounded mode.
+ */
+int64 SmallP_Carmichael::Delta_lower(Preproduct& P, int64 D){
+  if(!bounded_cars) return 1;
+
+  long double P_ld = P.Prod;
+  long double K = P_ld * (P_ld - 1) * (P_ld - 1) * (P_ld + D);
+  long double XD = (long double)X * D;
+  long double root = (K + sqrtl(K * K + 4 * XD * K * P_ld * (P_ld + D))) / (2 * XD);
+  root = root * (1 - 1e-12L) - 1;
+  if(root < 1) return 1;
+
+  // every divisor of (P-1)(P+D) is below this, and capping keeps the result in 64 bits
+  int64 Delta_cap = (P.Prod - 1) * (P.Prod + D);
+  if(root >= Delta_cap) return Delta_cap;
+  return (int64)root;
+}
+
+/* The C integrality test of completion_check, over a whole list of Delta.  As in CD_tail, while 
+ * P^2 + Delta < 2^52 the division can be done in doubles: (P^2 + Delta)/D is an integer exactly when 
+ * D divides P^2 + Delta, and adding and subtracting 2^52 rounds it to an integer.  Delta < Delta_bound 
+ * < P^2, so 2 P^2 < 2^52 is enough.  A block of Delta at a time goes through vector divides, and the 
+ * survivors are moved to the front, in order.  For larger P it is libdivide, one Delta at a time.
+ */
+void SmallP_Carmichael::filter_C_integral(int64 P2, int64 D, libdivide::divider<int64>& fastD, vector<int64>& Deltas){
+  const double two52 = 4503599627370496.0;
+  const uint64_t two52_bits = 0x4330000000000000;
+  long len = Deltas.size();
+  long kept = 0;
+  long k = 0;
+
+  if(2 * (double)P2 < two52){
+    double P2_double = P2;
+    double D_double = D;
+    double fraction[filter_lanes];
+    for(; k + filter_lanes <= len; k += filter_lanes){
+      // left rolled up so gcc vectorizes it, as in CD_tail
+      #pragma GCC unroll 1
+      for(long j = 0; j < filter_lanes; ++j){
+        // Delta < 2^52 to double by putting its bits under the exponent of 2^52, which vectorizes 
+        // where a plain conversion does not
+        uint64_t bits = (uint64_t)Deltas[k + j] | two52_bits;
+        double Delta_double;
+        memcpy(&Delta_double, &bits, sizeof(double));
+        double quotient = (P2_double + (Delta_double - two52)) / D_double;
+        fraction[j] = quotient - ((quotient + two52) - two52);
+      }
+      // kept <= k, so nothing not yet read is overwritten
+      for(long j = 0; j < filter_lanes; ++j){
+        if(fraction[j] == 0) Deltas[kept++] = Deltas[k + j];
+      }
+    }
+  }
+
+  // what is left over, or everything for larger P
+  for(; k < len; ++k){
+    int64 numerator = P2 + Deltas[k];
+    if(numerator - (numerator / fastD) * D == 0) Deltas[kept++] = Deltas[k];
+  }
+  Deltas.resize(kept);
+}
+
 // CD method (Pinch algorithm).  Given Preproduct and D, compute Carmichael completions
 // Something to note about multipilcation: P.Prod should be only 32 bits, so multiplication in 64 bits
 void SmallP_Carmichael::CD(Preproduct& P, bigint D, libdivide::divider<int64>& fastD){ 
@@ -469,29 +718,177 @@ void SmallP_Carmichael::CD(Preproduct& P, bigint D, libdivide::divider<int64>& f
   int64 Delta;
   int64 Delta_bound = (P.Prod - 1) * (P.Prod + D);
   Delta_bound = Delta_bound / (P.largest_prime() - 1);
+
+  // Delta = CD - P^2 must be at least Delta_lower, so C at least (P^2 + Delta_lower)/D, rounded up
+  int64 C_min = (P.Prod * P.Prod + Delta_lower(P, D) + D - 1) / D;
+  if(C_min > C_lower) C_lower = C_min;
+  
+  // and Delta < Delta_bound, so C at most (Delta_bound - 1 + P^2)/D
+  int64 C_max = (Delta_bound - 1 + P.Prod * P.Prod) / D;
+  if(C_max < C_upper) C_upper = C_max;
   
   // helper variables
   bool q_integral;
   bool some_carmichaels;
+  q_D = (P.Prod - 1) * (P.Prod + D);  
+
+  if(incremental_CD){
+    CD_incremental(P, D, fastD, C_lower, C_upper);
+    return;
+  }
 
   // loop over C
   for(int64 C = C_lower; C <= C_upper; ++C){
-    // compute Delta and q_D
+    // compute Delta
     // C*D is bounded by 2P^2, so multipication fits into 64 bits
     Delta = C * D - P.Prod * P.Prod;
-    q_D = (P.Prod - 1) * (P.Prod + D);  
 
     // check integrality of q
     q_integral = q_D % Delta == 0;
 
-    if(q_integral && Delta < Delta_bound){
+    if(q_integral){
       some_carmichaels = completion_check(P, Delta, D, fastD, C);
 
     }  
 
   } // end for C
 }
+
+/* The C loop of CD, without a divide for most C.  Delta = CD - P^2 goes up by D with each C, so the 
+ * quotient m and remainder of q_D by Delta can be carried along: q_D = m * Delta + rem becomes 
+ * q_D = m * (Delta + D) + (rem - m * D), and then m comes down until the remainder is back in range.
+ * Between consecutive Delta, m falls by about q_D * D / Delta^2, which is below 1 once Delta^2 > q_D * D, 
+ * and then one step of correction does it.  Below that Delta the quotient jumps, and each C is 
+ * tested with a divide as in CD.  Same Carmichaels in the same order as CD.
+ */
+void SmallP_Carmichael::CD_incremental(Preproduct& P, int64 D, libdivide::divider<int64>& fastD, int64 C_lower, 
+                                       int64 C_upper){
+  int64 C = C_lower;
+  int64 Delta = C * D - P.Prod * P.Prod;
+  int64 Delta_switch = (int64)sqrtl((long double)q_D * D) + 1;
+
+  // small Delta, where the quotient moves too fast to follow
+  for(; C <= C_upper && Delta < Delta_switch; ++C){
+    if(q_D % Delta == 0) completion_check(P, Delta, D, fastD, C);
+    Delta += D;
+  }
+  if(C > C_upper) return;
+
+  // from here m * D <= q_D * D / Delta < Delta, so nothing overflows
+  int64 m = q_D / Delta;
+  int64 rem = q_D - m * Delta;
+  for(; C <= C_upper; ++C){
+    if(rem == 0) completion_check(P, Delta, D, fastD, C);
+
+    // next Delta
+    Delta += D;
+    rem -= m * D;
+    while(rem < 0){
+      rem += Delta;
+      m--;
+    }
+  }
+}
     
+/* CD for every D in [D_start, D_stop), as the crossover runs it once P is past the D-Delta phase.
+ * There the C interval of each D holds only a few C, so the per D work of CD dominates: a libdivide 
+ * divider, 128-bit divides for the bounds since D is a bigint, and a 64-bit divide per C.
+ * Here D runs in blocks of CD_lanes consecutive values.  The bounds of each D are found in int64, with 
+ * the divides by p_{d-2} + 1 and p_{d-2} - 1 done by libdivide, since those are fixed for P.  Then the 
+ * test of q_D % Delta == 0 runs across the block a C offset at a time, in doubles: while q_D < 2^52 
+ * every quantity is exact, q_D / Delta is an integer exactly when Delta divides q_D, and adding and 
+ * subtracting 2^52 rounds it to an integer.  The loop has no branches or integer divides, so the compiler 
+ * vectorizes it over the lanes.  Only the (D, C) that pass go to completion_check, in order of D and then 
+ * C, so the Carmichaels come out as the loop over CD would give them.
+ * In bounded mode, for larger P, or when block_CD is false, this is just the loop over CD.
+ */
+void SmallP_Carmichael::CD_tail(Preproduct& P, int64 D_start, int64 D_stop){
+  libdivide::divider<int64> fast_D;
+  const double two52 = 4503599627370496.0;
+  int64 P2 = P.Prod * P.Prod;
+
+  if(!block_CD || bounded_cars || 2 * (double)P2 >= two52){
+    for(int64 D = D_start; D < D_stop; ++D){
+      res_D_index = (D - 1) % total_residue + 1;
+      fast_D = libdivide::divider<int64>(D);
+      CD(P, D, fast_D);
+    }
+    return;
+  }
+
+  int64 p = P.largest_prime();
+  libdivide::divider<int64> fast_p_plus(p + 1);
+  libdivide::divider<int64> fast_p_minus(p - 1);
+
+  // per lane: first C, number of C, and q_D, first Delta, D as doubles for the test
+  int64 C_first[CD_lanes];
+  long C_count[CD_lanes];
+  double q_D_lane[CD_lanes], Delta_first[CD_lanes], D_lane[CD_lanes];
+  double fraction[CD_lanes];
+  vector<pair<long, int64>> hits;   // (lane, C)
+
+  for(int64 D_block = D_start; D_block < D_stop; D_block += CD_lanes){
+    long max_count = 0;
+    for(long j = 0; j < CD_lanes; ++j){
+      int64 D = D_block + j;
+      if(D >= D_stop){
+        // idle lane, never hits
+        C_first[j] = 0;  C_count[j] = 0;
+        q_D_lane[j] = 0;  Delta_first[j] = 1;  D_lane[j] = 0;
+        continue;
+      }
+
+      // same bounds as CD
+      int64 Cu_temp = P2 / D;
+      int64 C_lower = 1 + Cu_temp;
+      int64 C_upper = Cu_temp + 2 * Cu_temp / fast_p_plus + 2;
+      int64 lane_q_D = (P.Prod - 1) * (P.Prod + D);
+      int64 Delta_bound = lane_q_D / fast_p_minus;
+      int64 C_max = (Delta_bound - 1 + P2) / D;
+      if(C_max < C_upper) C_upper = C_max;
+
+      C_first[j] = C_lower;
+      C_count[j] = (C_upper >= C_lower) ? C_upper - C_lower + 1 : 0;
+      q_D_lane[j] = lane_q_D;
+      Delta_first[j] = C_lower * D - P2;
+      D_lane[j] = D;
+      if(C_count[j] > max_count) max_count = C_count[j];
+    }
+
+    hits.clear();
+    for(long k = 0; k < max_count; ++k){
+      double k_double = k;
+
+      // fractional part of q_D / Delta for each lane.  Left rolled up, gcc turns this into vector 
+      // divides; unrolled first, it does not.
+      #pragma GCC unroll 1
+      for(long j = 0; j < CD_lanes; ++j){
+        double Delta = Delta_first[j] + k_double * D_lane[j];
+        double quotient = q_D_lane[j] / Delta;
+        fraction[j] = quotient - ((quotient + two52) - two52);
+      }
+
+      for(long j = 0; j < CD_lanes; ++j){
+        if(fraction[j] == 0 && k < C_count[j]) hits.push_back(pair<long, int64>(j, C_first[j] + k));
+      }
+    }
+    if(hits.size() == 0) continue;
+
+    // in order of D, then C
+    sort(hits.begin(), hits.end());
+    for(long h = 0; h < hits.size(); ++h){
+      int64 D = D_block + hits[h].first;
+      int64 C = hits[h].second;
+      if(h == 0 || hits[h].first != hits[h - 1].first){
+        res_D_index = (D - 1) % total_residue + 1;
+        fast_D = libdivide::divider<int64>(D);
+        q_D = (P.Prod - 1) * (P.Prod + D);
+      }
+      completion_check(P, C * D - P2, D, fast_D, C);
+    }
+  }
+}
+
 /* Once I have the loop over divisors of (P-1)(P+D)/Delta, I need to perform the following steps:
     1) Compute C = (P^2 + Delta)/D, check that it is integral (unless C != 0, meaning given as parameter)
     2) Check Pqr for Korselt criterion
@@ -562,212 +959,837 @@ bool SmallP_Carmichael::completion_check(Preproduct& P, int64 Delta, int64 D, li
   bigint modrminus = ((bigint)q * (bigint)P_val) % (r-1);
   if(modrminus != 1) return false;
  
-  // primality testing on q, r.  Will use a gmp func, so requires conversion to mpz
-  //mpz_t q_big;
-  //mpz_t r_big;
-  //mpz_init(q_big); mpz_init(r_big); 
+  // primality testing on q, r.  In a staged tabulation this is left to the primality stage.
+  if(!defer_primality && !prime_pair(q, r, q_mpz, r_mpz)) return false;
+
+  // If we have gotten to this point we have passed all the checks above
+  output.first = q;   output.second = r;
+  // write to the vector qrs
+  qrs.push_back(output);
+
+  return true;
+}
 
+/* Baillie-PSW on q and r, the primality part of completion_check.  q_big and r_big are scratch space.
+ * Only reads members, so the primality stage of tabulate_car_staged calls it from several threads.
+ */
+bool SmallP_Carmichael::prime_pair(int64 q_val, bigint r_val, mpz_t q_big, mpz_t r_big){
   // q can be converted directly.  r is possibly 128 bits, we need to use Dual_rep
-  mpz_set_si(q_mpz, q);
+  mpz_set_si(q_big, q_val);
   Dual_rep d;
-  d.double_word = r;
+  d.double_word = r_val;
 
   // Set the high bits, multiply by 2**64, then add over low bits
   // I think I have the si, ui correct here.  I tested it with examples where d.two_words[0] requires 64bits, 
   // and it worked fine.
-  mpz_set_si(r_mpz, d.two_words[1]);
-  mpz_mul_2exp(r_mpz, r_mpz, 64);
-  mpz_add_ui(r_mpz, r_mpz, d.two_words[0]);
+  mpz_set_si(r_big, d.two_words[1]);
+  mpz_mul_2exp(r_big, r_big, 64);
+  mpz_add_ui(r_big, r_big, d.two_words[0]);
 
   /*
   // testing
-  cout << "q in two different reps: " << q << " ";
+  cout << "q in two different reps: " << q_val << " ";
   mpz_out_str(nullptr, 10, q_big);
-  cout << "\n r in two different reps: " << r << " ";
+  cout << "\n r in two different reps: " << r_val << " ";
   mpz_out_str(nullptr, 10, r_big);
   cout << "\n";
   */
 
   // check pseudo-primality of q, r.  mpz_probab_prime_p could return 0, 1, or 2.  0 for composite
-  if(mpz_probab_prime_p(q_mpz, 0) == 0){
-   // mpz_clear(q_big);  mpz_clear(r_big);
+  if(mpz_probab_prime_p(q_big, 0) == 0){
     return false;
   }
-  if(mpz_probab_prime_p(r_mpz, 0) == 0){
-   // mpz_clear(q_big);  mpz_clear(r_big);
+  if(mpz_probab_prime_p(r_big, 0) == 0){
     return false;  
   }
 
-  // clear mpz
-  //mpz_clear(q_big);   mpz_clear(r_big);
-
-  // If we have gotten to this point we have passed all the checks above
-  output.first = q;   output.second = r;
-  // write to the vector qrs
-  qrs.push_back(output);
-
   return true;
 }
 
 /* Construct Carmichaels for a range of pre-products P < B
  */
 void SmallP_Carmichael::tabulate_car(long processor, long num_threads, string cars_file, bool verbose_output){
-  int64* P_factors;
-  long   P_factors_len;
-  int64* Pminus_factors;
-  long   Pminus_factors_len;
-  
-  // n is big enough in an unbounded computation to require mpz type
-  mpz_t n;
-  mpz_init(n);
+  tabulate_car_interval(B_lower, B_upper, processor, num_threads, cars_file, verbose_output);
+}
 
-  // let's also calculate the average value of L/P
-  //double avg_ratio = 0;
+/* Same as tabulate_car, but only pre-products P with start_val <= P < stop_val are considered.
+ * F is initialized at start_val rather than at B_lower, so no sieving is done outside the interval.
+ * Admissable pre-products are counted from the start of the interval, so with processor 0 of 1 
+ * the output is exactly the lines a serial run would write for those P.
+ *
+ * If checkpoint_file is set, progress is saved there (see Checkpoint.h).  If it already holds a checkpoint 
+ * for this same job, cars_file is cut back to the checkpointed offset and the sieve restarts at the 
+ * checkpointed P, so a killed job loses at most checkpoint_seconds of work.
+ */
+void SmallP_Carmichael::tabulate_car_interval(int64 start_val, int64 stop_val, long processor, long num_threads, 
+                                              string cars_file, bool verbose_output){
+  // restrict the interval to the pre-product bounds
+  int64 stop_P = (stop_val < B_upper) ? stop_val : B_upper;
+
+  // set start value to the first odd number greater or equal to the start of the interval
+  int64 start_P = (start_val > B_lower) ? start_val : B_lower;
+  if(start_P % 2 == 0) start_P++;
+
+  // pre-products come from the incremental sieve
+  SievePreproducts source;
+
+  if(checkpoint_file.size() == 0){
+    source.init(start_P, stop_P);
+    tabulate_car_source(source, processor, num_threads, cars_file, verbose_output);
+    return;
+  }
+
+  Checkpoint job;
+  job.start = start_P;  job.stop = stop_P;
+  job.processor = processor;  job.num_threads = num_threads;
+  job.cars_file = cars_file;
+  job.X = X;  job.bounded = bounded_cars;
+  job.next_P = start_P;
 
-  // file stream object
   ofstream output;
-  output.open(cars_file);
-  
-  // Issue: writing mpz_t to a file.
-  // Looking at stack overflow, write-quickly-gmp-variables-in-files, going to try FILE type
-  //FILE* output;
+  if(!open_checkpointed(job, output)) return;
 
-  // set start value to the first odd number greater or equal to B_lower
-  int64 start_P = B_lower;
-  if(start_P % 2 == 0) start_P++;
+  source.init(job.next_P, stop_P);
+  tabulate_car_stream(source, processor, num_threads, output, verbose_output, &job);
+  output.close();
+}
 
-  // initialize the Factgen2 object that stores factorizations of P, P-1
-  F.init(start_P - 1, B_upper);
- 
-  F.print();
+bool SmallP_Carmichael::open_checkpointed(Checkpoint& job, ofstream& output){
+  Checkpoint saved;
+  bool have_checkpoint = saved.read(checkpoint_file);
+  if(have_checkpoint && saved.same_job(job)){
+    // resume: keep only the output written before the checkpoint
+    cout << "resuming " << job.cars_file << " from " << checkpoint_file << " at P = " << saved.next_P;
+    cout << ", keeping the first " << saved.offset << " bytes\n";
+    if(truncate(job.cars_file.c_str(), saved.offset) != 0){
+      cout << "Error in open_checkpointed, could not truncate " << job.cars_file << "\n";
+      return false;
+    }
+    job = saved;
+    output.open(job.cars_file, ios::in | ios::out);
+    output.seekp(job.offset);
+  }else{
+    if(have_checkpoint) cout << checkpoint_file << " is for a different job, starting " << job.cars_file << " over\n";
+    output.open(job.cars_file);
+  }
+  return true;
+}
 
-  // count the number of admissable pre-products
-  int64 num_admissable = 0;
+/* Threaded tabulation.  [B_lower, B_upper) is cut into contiguous chunks of crossover_batch admissable 
+ * pre-products each, and the estimated cost of each chunk is found with preproduct_cost.  Workers claim 
+ * chunks a window of 16 per worker at a time, and within a window most expensive first (longest processing 
+ * time first).  Cost grows with P, so the last window holds the most expensive chunks, and ending it with 
+ * its shortest ones lets the workers finish together.  A worker has its own SmallP_Carmichael as its context: 
+ * its own sieves, mpz variables, and qrs.  The tables all workers read are the shared prime base, which is 
+ * extended up front so that no worker ever has to grow it, and the residue tables, which each context fills 
+ * identically.
+ * Output for a chunk goes to a buffer for that chunk.  A finished buffer is written to cars_file as soon as 
+ * every chunk before it has been written, so the file matches a serial run and only the chunks finished out 
+ * of order are held in memory.  If checkpoint_file is set, a checkpoint at the end of the written chunks is 
+ * saved every checkpoint_seconds.  It is for the same job as a serial tabulate_car, so either resumes the other.
+ */
+void SmallP_Carmichael::tabulate_car_threaded(long num_workers, string cars_file, bool verbose_output){
+  int64 start_P = (B_lower % 2 == 0) ? B_lower + 1 : B_lower;
+  if(num_workers < 1) num_workers = 1;
 
-  // set the P residue
-  res_P_index = start_P % total_residue;
+  prepare_shared_tables();
 
-  // Now loop over odd pre-products P
-  for(int64 P = start_P; P < B_upper; P = P + 2){
+  // the job of tabulate_car(0, 1, cars_file), resumed from its checkpoint if there is one
+  Checkpoint job;
+  job.start = start_P;  job.stop = B_upper;
+  job.processor = 0;  job.num_threads = 1;
+  job.cars_file = cars_file;
+  job.X = X;  job.bounded = bounded_cars;
+  job.next_P = start_P;
+  bool checkpointing = (checkpoint_file.size() > 0);
 
-    // retrieve factorizations of P, P-1
-    P_factors = F.current;
-    P_factors_len = F.currentlen;
-    Pminus_factors = F.prev;
-    Pminus_factors_len = F.prevlen;
+  ofstream output;
+  if(checkpointing){
+    if(!open_checkpointed(job, output)) return;
+  }else{
+    output.open(cars_file);
+  }
 
-    /*
-    cout << "inside tabulate_car, considering P = " << P << ": ";
-    for(long i = 0; i < P_factors_len; i++){
-      cout << P_factors[i] << " ";
+  // chunk boundaries and costs
+  vector<int64> bounds;
+  vector<double> costs;
+  cost_profile(job.next_P, B_upper, crossover_batch, bounds, costs);
+  long num_chunks = costs.size();
+
+  // dispatch order: windows of consecutive chunks in turn, most expensive first within a window.  The 
+  // written part of the file, and so the checkpoint, is never much more than a window behind.
+  long window = 16 * num_workers;
+  vector<long> order(num_chunks);
+  for(long c = 0; c < num_chunks; ++c) order[c] = c;
+  sort(order.begin(), order.end(), [&](long a, long b){
+    if(a / window != b / window) return a < b;
+    return costs[a] > costs[b];
+  });
+
+  // output in chunk order.  Finished chunks that can't be written yet wait in pending.
+  mutex output_lock;
+  map<long, string> pending;
+  vector<int64> chunk_admissable(num_chunks);
+  long next_to_write = 0;
+  int64 num_admissable = job.num_admissable;
+  auto last_checkpoint = chrono::steady_clock::now();
+
+  atomic<long> next_chunk(0);
+
+  // each worker claims chunks until none are left
+  auto work = [&](long w){
+    // pin first, so the context is allocated on this worker's node
+    if(pin_workers) pin_worker(w);
+    SmallP_Carmichael context = SmallP_Carmichael(B_lower, B_upper, X, bounded_cars);
+    context.copy_tuning(*this);
+    SievePreproducts source;
+    for(long i = next_chunk++; i < num_chunks; i = next_chunk++){
+      long c = order[i];
+      ostringstream buffer;
+      source.init(bounds[c], bounds[c + 1]);
+      int64 admissable = context.tabulate_car_stream(source, 0, 1, buffer, verbose_output);
+
+      // write this chunk and any that were waiting on it
+      lock_guard<mutex> guard(output_lock);
+      pending[c] = buffer.str();
+      chunk_admissable[c] = admissable;
+      while(!pending.empty() && pending.begin()->first == next_to_write){
+        output << pending.begin()->second;
+        num_admissable += chunk_admissable[next_to_write];
+        pending.erase(pending.begin());
+        next_to_write++;
+      }
+
+      // everything below bounds[next_to_write] is written
+      if(checkpointing && next_to_write < num_chunks){
+        chrono::duration<double> since = chrono::steady_clock::now() - last_checkpoint;
+        if(since.count() >= checkpoint_seconds){
+          save_checkpoint(job, bounds[next_to_write], num_admissable, output);
+          last_checkpoint = chrono::steady_clock::now();
+        }
+      }
     }
-    cout << "\n";
-    */
+  };
 
-    // construct Preproduct object
-    Preproduct P_ob = Preproduct(P, P_factors, P_factors_len, Pminus_factors, Pminus_factors_len);
+  vector<thread> workers;
+  for(long w = 0; w < num_workers; ++w) workers.push_back(thread(work, w));
+  for(long w = 0; w < num_workers; ++w) workers[w].join();
 
-    // add ratio L/P to the running total
-    //avg_ratio += P_ob.L / (P + 0.0) ;
+  if(checkpointing) save_checkpoint(job, B_upper, num_admissable, output);
+  output.close();
+}
 
-    // check admissability.  If so, add to count
-    if(P_ob.admissable) num_admissable++;
+/* Estimated time for preproduct_crossover on P, in arbitrary units.
+ * The CD phase runs over C intervals of total length about L_p log(P / D), and the D-Delta phase over 
+ * divisors of (P-1)(P+D), whose count grows with Tau.  Fitting log time against log L_p, log P and log Tau 
+ * over a sample of P up to 10^6 gave exponents close to 1/2, 1/2 and 1/8, and the fit tracks the 
+ * measured time with correlation 0.98 on a log scale.
+ */
+double SmallP_Carmichael::preproduct_cost(Preproduct& P){
+  double P_val = (double)P.Prod;
+  double L_p = 2 * P_val * P_val / P.largest_prime();
+  return sqrt(L_p * P_val) * pow((double)P.Tau, 0.125);
+}
 
-    // If Pp^2 >= X, throw out that preproduct
+/* Cut [start_val, stop_val) into consecutive chunks, each holding per_chunk of the pre-products 
+ * tabulate_car would work on (admissable and passing the bound check), except the last which may hold fewer.
+ * Chunk c is [bounds[c], bounds[c+1]) and its estimated cost is costs[c].
+ */
+void SmallP_Carmichael::cost_profile(int64 start_val, int64 stop_val, long per_chunk, 
+                                     vector<int64>& bounds, vector<double>& costs){
+  bounds.clear();
+  costs.clear();
+  if(start_val >= stop_val) return;
+  if(per_chunk < 1) per_chunk = 1;
+
+  SievePreproducts source;
+  source.init(start_val, stop_val);
+  bounds.push_back(start_val);
+  long count = 0;
+  double cost = 0;
+
+  while(source.next()){
+    int64 P = source.P;
+    Preproduct P_ob = Preproduct(P, source.Pprimes, source.Pprimes_len, source.Pminus, source.Pminus_exps, 
+                                 source.Pminus_len);
+
+    // same bound check as tabulate_car
     bool bounded_pass;
     if(!bounded_cars){
       bounded_pass = true;
     }else{
-      // this next line needs to be fixed. X is bigint, multiplication probably int64
-      bounded_pass = P * P_factors[P_factors_len - 1] * P_factors[P_factors_len - 1] < X;
+      int64 largest = source.Pprimes[source.Pprimes_len - 1];
+      bounded_pass = P * largest * largest < X;
     }
 
-    // if num_admissable has the correct residue and pass bounded check, do work, otherwise continue
-    if( (num_admissable % num_threads) != (processor % num_threads) || !bounded_pass){
-      F.next();
-      F.next();
+    if(P_ob.admissable && bounded_pass){
+      count++;
+      cost += preproduct_cost(P_ob);
+    }
 
-      // update the P index
-      res_P_index += 2;
-      if(res_P_index > total_residue) res_P_index -= total_residue;
+    // close the chunk just after P
+    if(count == per_chunk && P + 1 < stop_val){
+      bounds.push_back(P + 1);
+      costs.push_back(cost);
+      count = 0;
+      cost = 0;
+    }
+  }
 
-    }else{
-      // if admissable, construct Carmichaels
-      if(P_ob.admissable){
-    
-        // testing
-        //cout << "admissable preproduct considered: " << P_ob.Prod << "\n";
- 
-        // Construct all Carmichael numbers with pre-product P.  First clear the qrs member variable
-        qrs.clear();
+  // the last chunk
+  bounds.push_back(stop_val);
+  costs.push_back(cost);
+}
 
-        // if the largest prime dividing pre-product is large enough, do cross-over
-        preproduct_crossover(P_ob);
-        
-        // testing
-        //cout << "P = " << P << " generates " << qrs.size() << " many carmichaels\n";
+/* Split [start_val, stop_val) into num_parts contiguous intervals of about equal estimated cost, for 
+ * array jobs that each take one interval (see tabulate_car_interval).  Returns num_parts + 1 boundaries.
+ */
+vector<int64> SmallP_Carmichael::cost_balanced_bounds(int64 start_val, int64 stop_val, long num_parts){
+  vector<int64> chunk_bounds;
+  vector<double> chunk_costs;
+  cost_profile(start_val, stop_val, crossover_batch, chunk_bounds, chunk_costs);
+
+  double total = 0;
+  for(long c = 0; c < chunk_costs.size(); ++c) total += chunk_costs[c];
+
+  // part k ends at the first chunk boundary where the running cost reaches (k+1)/num_parts of the total
+  vector<int64> part_bounds(1, start_val);
+  double running = 0;
+  long part = 1;
+  for(long c = 0; c < chunk_costs.size() && part < num_parts; ++c){
+    running += chunk_costs[c];
+    while(part < num_parts && running >= total * part / num_parts){
+      part_bounds.push_back(chunk_bounds[c + 1]);
+      part++;
+    }
+  }
+  // any parts left over are empty
+  while(part_bounds.size() < num_parts) part_bounds.push_back(stop_val);
+  part_bounds.push_back(stop_val);
+  return part_bounds;
+}
 
-        // print to file
-        //output << "Carmichaels for P = " << P << " number of Cars is " << qrs.size() << "\n";
-        for(long j = 0; j < qrs.size(); ++j){
+/* Pipelined tabulation.  The calling thread is the producer: it runs the incremental sieve once over 
+ * [B_lower, B_upper), builds a Preproduct for each P, and pushes admissable ones onto a bounded 
+ * lock-free queue in batches of crossover_batch.  num_workers consumer threads pop batches and run 
+ * preproduct_crossover_batch, each in its own SmallP_Carmichael context.  Batches are numbered, and 
+ * a finished batch's output is held until every earlier batch has been written, so the file matches 
+ * a serial run.  Unlike round-robin over num_admissable, the sieve and the Preproduct constructions 
+ * are done once in total, not once per worker.
+ */
+void SmallP_Carmichael::tabulate_car_pipeline(long num_workers, string cars_file, bool verbose_output){
+  int64 start_P = (B_lower % 2 == 0) ? B_lower + 1 : B_lower;
+  if(num_workers < 1) num_workers = 1;
 
-          // compute n.  Set it to r using dualrep, then multiply by q and by P
-          Dual_rep d;
-          d.double_word = qrs.at(j).second;
-          // set high bits, multiply by 2**64, add low bits
-          mpz_set_si(n, d.two_words[1]);
-          mpz_mul_2exp(n, n, 64);
-          mpz_add_ui(n, n, d.two_words[0]);
-
-          // multiply by P and by q
-          mpz_mul_si(n, n, P_ob.Prod);
-          mpz_mul_si(n, n, qrs.at(j).first);          
-
-          // if bounded, only print if n < X.  Also print if not bounded.
-          // this line is not the correct approach to boundedness
-          //if(n < X || !bounded_cars){
-
-            // output depends on the input bool verbose_output.  If true, give n followed by factors
-            if(verbose_output){
-
-              // now print n followed by its factors, space separated.  First convert n to a string
-              //char* n_cstr = NULL;
-              //mpz_get_str(n_cstr, 10, n);
-              //string n_str = string(n_cstr);
-
-              output << n << " ";
-              for(long k = 0; k < P_ob.Pprimes_len; k++){
-                output << P_ob.Pprimes[k] << " ";
-              } 
-              output << qrs.at(j).first << " " << qrs.at(j).second << "\n";
-
-              //delete[] n_cstr;
-
-            }else{
-              // otherwise, output preproduct P, followed by q then r
-              output << P << " " << qrs.at(j).first << " " << qrs.at(j).second << "\n";
-            }
-          //}
-        } // end for
-      } // end if admissable
-      // move the factorization window to next odd number
-      F.next();
-      F.next();
+  prepare_shared_tables();
 
-      // update the P index
-      res_P_index += 2;
-      if(res_P_index > total_residue) res_P_index -= total_residue;
-    
-    } // end if correct processor
-  } // end for P 
+  // a batch of consecutive admissable pre-products, with its place in the output
+  struct PreproductBatch{
+    long seq;
+    vector<Preproduct> batch;
+    vector<long> residues;
+  };
 
-  // close file and clear the qrs
+  // a few batches per worker is enough to keep the workers busy
+  BoundedQueue<PreproductBatch*> queue(4 * num_workers);
+  atomic<bool> producer_done(false);
+
+  // output in batch order.  Finished batches that can't be written yet wait in pending.
+  ofstream output;
+  output.open(cars_file);
+  mutex output_lock;
+  map<long, string> pending;
+  long next_to_write = 0;
+
+  auto work = [&](long w){
+    if(pin_workers) pin_worker(w);
+    SmallP_Carmichael context = SmallP_Carmichael(B_lower, B_upper, X, bounded_cars);
+    context.copy_tuning(*this);
+    vector<vector<pair<int64, bigint>>> batch_qrs;
+    mpz_t n;
+    mpz_init(n);
+
+    PreproductBatch* item;
+    while(true){
+      if(!queue.pop(item)){
+        // the producer may have pushed its last batch just before setting done, so check once more
+        if(producer_done.load(memory_order_acquire)){
+          if(!queue.pop(item)) break;
+        }else{
+          this_thread::yield();
+          continue;
+        }
+      }
+
+      context.preproduct_crossover_batch(item->batch, item->residues, batch_qrs);
+      ostringstream buffer;
+      for(long k = 0; k < item->batch.size(); ++k){
+        context.write_cars(buffer, item->batch[k], batch_qrs[k], n, verbose_output);
+      }
+
+      // write this batch and any that were waiting on it
+      {
+        lock_guard<mutex> guard(output_lock);
+        pending[item->seq] = buffer.str();
+        while(!pending.empty() && pending.begin()->first == next_to_write){
+          output << pending.begin()->second;
+          pending.erase(pending.begin());
+          next_to_write++;
+        }
+      }
+      delete item;
+    }
+    mpz_clear(n);
+  };
+
+  vector<thread> workers;
+  for(long w = 0; w < num_workers; ++w) workers.push_back(thread(work, w));
+
+  // producer
+  SievePreproducts source;
+  source.init(start_P, B_upper);
+  long seq = 0;
+  PreproductBatch* item = new PreproductBatch;
+  item->seq = seq;
+  item->batch.reserve(crossover_batch);
+
+  bool more_P = true;
+  while(more_P){
+    more_P = source.next();
+
+    if(more_P){
+      int64 P = source.P;
+      Preproduct P_ob = Preproduct(P, source.Pprimes, source.Pprimes_len, source.Pminus, source.Pminus_exps, 
+                                   source.Pminus_len);
+
+      // If Pp^2 >= X, throw out that preproduct
+      bool bounded_pass;
+      if(!bounded_cars){
+        bounded_pass = true;
+      }else{
+        // this next line needs to be fixed. X is bigint, multiplication probably int64
+        int64 largest = source.Pprimes[source.Pprimes_len - 1];
+        bounded_pass = P * largest * largest < X;
+      }
+
+      if(P_ob.admissable && bounded_pass){
+        item->batch.push_back(P_ob);
+        item->residues.push_back(P % total_residue);
+      }
+    }
+
+    // hand off a full batch, or the last one
+    if(item->batch.size() == crossover_batch || (!more_P && item->batch.size() > 0)){
+      while(!queue.push(item)) this_thread::yield();
+      seq++;
+      item = new PreproductBatch;
+      item->seq = seq;
+      item->batch.reserve(crossover_batch);
+    }
+  }
+  delete item;
+  producer_done.store(true, memory_order_release);
+
+  for(long w = 0; w < num_workers; ++w) workers[w].join();
   output.close();
+}
+
+/* Staged tabulation.  The work for a batch of pre-products passes through five stages, each fed by a 
+ * bounded lock-free queue:
+ *   1) sieve, in the calling thread: factorizations of P and P-1 for the P the source hands out, copied 
+ *      into a batch of crossover_batch of them
+ *   2) admissability, admissable_threads threads: build each Preproduct, keep the admissable and bounded ones
+ *   3) construction, construction_threads threads: preproduct_crossover_batch with defer_primality set, so 
+ *      the D loop keeps every (q, r) that passes Korselt without stopping for GMP
+ *   4) primality, primality_threads threads: Baillie-PSW on q and r with prime_pair, dropping failures
+ *   5) output, one thread: formats the Carmichaels and writes the batches to cars_file in order
+ * Each batch keeps its sequence number from stage 1, so the file matches a serial run.  A stage finishes 
+ * when the stage before it has finished and its queue is empty.  The queues hold a few batches per thread, 
+ * so a slow stage holds up the ones before it rather than letting batches pile up in memory.
+ */
+void SmallP_Carmichael::tabulate_car_staged(long admissable_threads, long construction_threads, long primality_threads, 
+                                            string cars_file, bool verbose_output){
+  int64 start_P = (B_lower % 2 == 0) ? B_lower + 1 : B_lower;
+  if(admissable_threads < 1) admissable_threads = 1;
+  if(construction_threads < 1) construction_threads = 1;
+  if(primality_threads < 1) primality_threads = 1;
+
+  prepare_shared_tables();
+
+  // a batch on its way through the stages.  Factorizations from the sieve are stored back to back:
+  // those of values[i] start at P_offsets[i] and Pminus_offsets[i], and run to the next offset.
+  struct StagedBatch{
+    long seq;
+    vector<int64> values;
+    vector<int64> P_primes;
+    vector<long>  P_offsets;
+    vector<int64> Pminus;
+    vector<long>  Pminus_exps;
+    vector<long>  Pminus_offsets;
+
+    vector<Preproduct> batch;
+    vector<long> residues;
+    vector<vector<pair<int64, bigint>>> batch_qrs;
+  };
+
+  BoundedQueue<StagedBatch*> to_admissable(4 * admissable_threads);
+  BoundedQueue<StagedBatch*> to_construction(4 * construction_threads);
+  BoundedQueue<StagedBatch*> to_primality(4 * primality_threads);
+  BoundedQueue<StagedBatch*> to_output(4 * primality_threads);
+
+  atomic<bool> sieve_done(false), admissable_done(false), construction_done(false), primality_done(false);
+  atomic<long> admissable_left(admissable_threads);
+  atomic<long> construction_left(construction_threads);
+  atomic<long> primality_left(primality_threads);
+
+  auto push_item = [](BoundedQueue<StagedBatch*>& queue, StagedBatch* item){
+    while(!queue.push(item)) this_thread::yield();
+  };
+  // false once upstream is done and the queue is empty.  Everything upstream pushed happens before its 
+  // done flag is set, so one more pop after seeing the flag cannot miss a batch.
+  auto pop_item = [](BoundedQueue<StagedBatch*>& queue, atomic<bool>& upstream_done, StagedBatch*& item){
+    while(true){
+      if(queue.pop(item)) return true;
+      if(upstream_done.load(memory_order_acquire)) return queue.pop(item);
+      this_thread::yield();
+    }
+  };
+  // the last thread of a stage to finish marks the stage done
+  auto leave_stage = [](atomic<long>& left, atomic<bool>& done){
+    if(--left == 0) done.store(true, memory_order_release);
+  };
+
+  auto admissable_work = [&](){
+    StagedBatch* item;
+    while(pop_item(to_admissable, sieve_done, item)){
+      item->batch.reserve(item->values.size());
+      for(long i = 0; i < item->values.size(); ++i){
+        int64 P = item->values[i];
+        long P_len = item->P_offsets[i + 1] - item->P_offsets[i];
+        long Pminus_len = item->Pminus_offsets[i + 1] - item->Pminus_offsets[i];
+        int64* P_fac = &item->P_primes[ item->P_offsets[i] ];
+
+        // If Pp^2 >= X, throw out that preproduct
+        bool bounded_pass;
+        if(!bounded_cars){
+          bounded_pass = true;
+        }else{
+          int64 largest = P_fac[P_len - 1];
+          bounded_pass = P * largest * largest < X;
+        }
+        if(!bounded_pass) continue;
+
+        Preproduct P_ob = Preproduct(P, P_fac, P_len, &item->Pminus[ item->Pminus_offsets[i] ], 
+                                     &item->Pminus_exps[ item->Pminus_offsets[i] ], Pminus_len);
+        if(P_ob.admissable){
+          item->batch.push_back(P_ob);
+          item->residues.push_back(P % total_residue);
+        }
+      }
+      push_item(to_construction, item);
+    }
+    leave_stage(admissable_left, admissable_done);
+  };
+
+  auto construction_work = [&](long w){
+    if(pin_workers) pin_worker(w);
+    SmallP_Carmichael context = SmallP_Carmichael(B_lower, B_upper, X, bounded_cars);
+    context.copy_tuning(*this);
+    context.defer_primality = true;
+
+    StagedBatch* item;
+    while(pop_item(to_construction, admissable_done, item)){
+      context.preproduct_crossover_batch(item->batch, item->residues, item->batch_qrs);
+      push_item(to_primality, item);
+    }
+    leave_stage(construction_left, construction_done);
+  };
+
+  auto primality_work = [&](){
+    mpz_t q_big, r_big;
+    mpz_init(q_big);  mpz_init(r_big);
+
+    StagedBatch* item;
+    while(pop_item(to_primality, construction_done, item)){
+      for(long k = 0; k < item->batch_qrs.size(); ++k){
+        vector<pair<int64, bigint>>& cands = item->batch_qrs[k];
+        long kept = 0;
+        for(long j = 0; j < cands.size(); ++j){
+          if(prime_pair(cands[j].first, cands[j].second, q_big, r_big)) cands[kept++] = cands[j];
+        }
+        cands.resize(kept);
+      }
+      push_item(to_output, item);
+    }
+    mpz_clear(q_big);  mpz_clear(r_big);
+    leave_stage(primality_left, primality_done);
+  };
+
+  // finished batches that can't be written yet wait in pending
+  auto output_work = [&](){
+    ofstream output;
+    output.open(cars_file);
+    mpz_t n;
+    mpz_init(n);
+    map<long, StagedBatch*> pending;
+    long next_to_write = 0;
+
+    StagedBatch* item;
+    while(pop_item(to_output, primality_done, item)){
+      pending[item->seq] = item;
+      while(!pending.empty() && pending.begin()->first == next_to_write){
+        StagedBatch* ready = pending.begin()->second;
+        for(long k = 0; k < ready->batch.size(); ++k){
+          write_cars(output, ready->batch[k], ready->batch_qrs[k], n, verbose_output);
+        }
+        delete ready;
+        pending.erase(pending.begin());
+        next_to_write++;
+      }
+    }
+    mpz_clear(n);
+    output.close();
+  };
+
+  vector<thread> threads;
+  for(long w = 0; w < admissable_threads; ++w) threads.push_back(thread(admissable_work));
+  for(long w = 0; w < construction_threads; ++w) threads.push_back(thread(construction_work, w));
+  for(long w = 0; w < primality_threads; ++w) threads.push_back(thread(primality_work));
+  threads.push_back(thread(output_work));
+
+  // sieve
+  SievePreproducts source;
+  source.init(start_P, B_upper);
+  long seq = 0;
+  StagedBatch* item = new StagedBatch;
+  item->seq = seq;
+  item->P_offsets.push_back(0);
+  item->Pminus_offsets.push_back(0);
+
+  bool more_P = true;
+  while(more_P){
+    more_P = source.next();
+
+    if(more_P){
+      item->values.push_back(source.P);
+      item->P_primes.insert(item->P_primes.end(), source.Pprimes, source.Pprimes + source.Pprimes_len);
+      item->P_offsets.push_back(item->P_primes.size());
+      item->Pminus.insert(item->Pminus.end(), source.Pminus, source.Pminus + source.Pminus_len);
+      item->Pminus_exps.insert(item->Pminus_exps.end(), source.Pminus_exps, source.Pminus_exps + source.Pminus_len);
+      item->Pminus_offsets.push_back(item->Pminus.size());
+    }
+
+    // hand off a full batch, or the last one
+    if(item->values.size() == crossover_batch || (!more_P && item->values.size() > 0)){
+      push_item(to_admissable, item);
+      seq++;
+      item = new StagedBatch;
+      item->seq = seq;
+      item->P_offsets.push_back(0);
+      item->Pminus_offsets.push_back(0);
+    }
+  }
+  delete item;
+  sieve_done.store(true, memory_order_release);
+
+  for(long t = 0; t < threads.size(); ++t) threads[t].join();
+}
+
+// Extend the shared prime base so that no sieve will need to grow it while threads are running.
+// The P+D sieve for P near B_upper needs primes below 2*(1+sqrt(2 B_upper)), the most any sieve needs.
+void SmallP_Carmichael::prepare_shared_tables(){
+  int64 prime_bound = 1 + sqrt(2 * B_upper);
+  prime_base(2 * prime_bound + 2);
+}
+
+/* Same as tabulate_car, with pre-products taken from an initialized source (see PreproductSource.h).
+ * The source may hand out inadmissable P, which are thrown out here.
+ */
+void SmallP_Carmichael::tabulate_car_source(PreproductSource& source, long processor, long num_threads, 
+                                            string cars_file, bool verbose_output){
+  // file stream object
+  ofstream output;
+  output.open(cars_file);
+  
+  // Issue: writing mpz_t to a file.
+  // Looking at stack overflow, write-quickly-gmp-variables-in-files, going to try FILE type
+  //FILE* output;
+
+  tabulate_car_stream(source, processor, num_threads, output, verbose_output);
+
+  // close file
+  output.close();
+}
+
+/* The work of tabulate_car_source, writing to any output stream.
+ * If checkpoint is given, counting starts from its num_admissable, and every checkpoint_seconds the output 
+ * is flushed and the checkpoint rewritten once the current batch is written.  A final checkpoint marks 
+ * the job as finished.  Returns the number of admissable pre-products counted.
+ */
+int64 SmallP_Carmichael::tabulate_car_stream(PreproductSource& source, long processor, long num_threads, 
+                                             ostream& output, bool verbose_output, Checkpoint* checkpoint){
+  // n is big enough in an unbounded computation to require mpz type
+  mpz_t n;
+  mpz_init(n);
+
+  // let's also calculate the average value of L/P
+  //double avg_ratio = 0;
+
+  // count the number of admissable pre-products
+  int64 num_admissable = (checkpoint == nullptr) ? 0 : checkpoint->num_admissable;
+
+  // the last P handed out by the source, and when the last checkpoint was written
+  int64 last_P = 0;
+  auto last_checkpoint = chrono::steady_clock::now();
+
+  // threads that split the D range read the shared prime base
+  if(crossover_threads > 1) prepare_shared_tables();
+
+  // Admissable pre-products for this processor are collected into a batch, along with their residues.
+  // preproduct_crossover_batch then sieves the values P+D once for the whole batch.
+  vector<Preproduct> batch;
+  vector<long> batch_residues;
+  vector<vector<pair<int64, bigint>>> batch_qrs;
+  batch.reserve(crossover_batch);
+
+  // Now loop over the pre-products P handed out by the source
+  bool more_P = true;
+  while(more_P){
+    more_P = source.next();
+
+    if(more_P){
+      int64 P = source.P;
+      last_P = P;
+
+      /*
+      cout << "inside tabulate_car, considering P = " << P << ": ";
+      for(long i = 0; i < source.Pprimes_len; i++){
+        cout << source.Pprimes[i] << " ";
+      }
+      cout << "\n";
+      */
+
+      // construct Preproduct object
+      Preproduct P_ob = Preproduct(P, source.Pprimes, source.Pprimes_len, source.Pminus, source.Pminus_exps, 
+                                   source.Pminus_len);
+
+      // add ratio L/P to the running total
+      //avg_ratio += P_ob.L / (P + 0.0) ;
+
+      // check admissability.  If so, add to count
+      if(P_ob.admissable) num_admissable++;
+
+      // If Pp^2 >= X, throw out that preproduct
+      bool bounded_pass;
+      if(!bounded_cars){
+        bounded_pass = true;
+      }else{
+        // this next line needs to be fixed. X is bigint, multiplication probably int64
+        int64 largest = source.Pprimes[source.Pprimes_len - 1];
+        bounded_pass = P * largest * largest < X;
+      }
+
+      // if admissable, num_admissable has the correct residue, and pass bounded check, add to the batch
+      if( P_ob.admissable && (num_admissable % num_threads) == (processor % num_threads) && bounded_pass){
+        if(crossover_threads > 1 && P >= min_split_P){
+          // large P get threads of their own.  Earlier P in the batch are written first, to keep the order.
+          preproduct_crossover_batch(batch, batch_residues, batch_qrs);
+          for(long k = 0; k < batch.size(); ++k){
+            write_cars(output, batch[k], batch_qrs[k], n, verbose_output);
+          }
+          batch.clear();
+          batch_residues.clear();
+
+          preproduct_crossover_split(P_ob, crossover_threads);
+          write_cars(output, P_ob, qrs, n, verbose_output);
+          qrs.clear();
+        }else{
+          batch.push_back(P_ob);
+          batch_residues.push_back(P % total_residue);
+        }
+      }
+    }
+
+    // once the batch is full, or there are no more P, construct Carmichaels and print to file
+    if(batch.size() == crossover_batch || (!more_P && batch.size() > 0)){
+      preproduct_crossover_batch(batch, batch_residues, batch_qrs);
+
+      for(long k = 0; k < batch.size(); ++k){
+        // testing
+        //cout << "P = " << batch[k].Prod << " generates " << batch_qrs[k].size() << " many carmichaels\n";
+        write_cars(output, batch[k], batch_qrs[k], n, verbose_output);
+      }
+      batch.clear();
+      batch_residues.clear();
+    }
+
+    // with the batch empty, everything up to last_P is written, so this is a safe point for a checkpoint
+    if(checkpoint != nullptr && more_P && batch.size() == 0){
+      chrono::duration<double> since = chrono::steady_clock::now() - last_checkpoint;
+      if(since.count() >= checkpoint_seconds){
+        save_checkpoint(*checkpoint, last_P + 1, num_admissable, output);
+        last_checkpoint = chrono::steady_clock::now();
+      }
+    }
+  } // end while more P
+
+  if(checkpoint != nullptr) save_checkpoint(*checkpoint, checkpoint->stop, num_admissable, output);
+
+  // clear the qrs
   qrs.clear();
   mpz_clear(n);
 
   // to stdout print avg ratio
   //cout << "average ratio of L/P is " << avg_ratio / num_admissable << "\n";
+  return num_admissable;
+}
+
+// flush output and record that everything below next_P is in it
+void SmallP_Carmichael::save_checkpoint(Checkpoint& checkpoint, int64 next_P, int64 num_admissable, ostream& output){
+  output.flush();
+  checkpoint.next_P = next_P;
+  checkpoint.num_admissable = num_admissable;
+  checkpoint.offset = output.tellp();
+  checkpoint.write(checkpoint_file);
+}
+
+/* Print the Carmichaels P q r for the pairs (q, r) in cars.  n is scratch space for the product.
+ * If verbose_output, print n followed by its prime factors.  Otherwise print P, q, r.
+ */
+void SmallP_Carmichael::write_cars(ostream& output, Preproduct& P_ob, vector<pair<int64, bigint>>& cars, 
+                                   mpz_t n, bool verbose_output){
+  for(long j = 0; j < cars.size(); ++j){
+
+    // compute n.  Set it to r using dualrep, then multiply by q and by P
+    Dual_rep d;
+    d.double_word = cars.at(j).second;
+    // set high bits, multiply by 2**64, add low bits
+    mpz_set_si(n, d.two_words[1]);
+    mpz_mul_2exp(n, n, 64);
+    mpz_add_ui(n, n, d.two_words[0]);
+
+    // multiply by P and by q
+    mpz_mul_si(n, n, P_ob.Prod);
+    mpz_mul_si(n, n, cars.at(j).first);          
+
+    // if bounded, only print if n < X.  Also print if not bounded.
+    // this line is not the correct approach to boundedness
+    //if(n < X || !bounded_cars){
+
+      // output depends on the input bool verbose_output.  If true, give n followed by factors
+      if(verbose_output){
+        output << n << " ";
+        for(long k = 0; k < P_ob.Pprimes_len; k++){
+          output << P_ob.Pprimes[k] << " ";
+        } 
+        output << cars.at(j).first << " " << cars.at(j).second << "\n";
+
+      }else{
+        // otherwise, output preproduct P, followed by q then r
+        output << P_ob.Prod << " " << cars.at(j).first << " " << cars.at(j).second << "\n";
+      }
+    //}
+  } // end for
 }
 
 /* Construct Carmichaels for prime pre-products P, using just D-Delta method
@@ -777,7 +1799,6 @@ void SmallP_Carmichael::tabulate_car_primeP(long processor, long num_threads, st
   long   P_factors_len;
   int64* Pminus_factors;
   long   Pminus_factors_len;
-  Preproduct P_ob;
 
   // file stream object
   ofstream output;
@@ -792,16 +1813,25 @@ void SmallP_Carmichael::tabulate_car_primeP(long processor, long num_threads, st
   // set P residue
   res_P_index = 3;
 
-  // loop over pre-products
-  for(int64 P = 3; P < B_upper; ++P){
+  // Multiples of 3, 5, 7 can't be prime pre-products, other than 3, 5, 7 themselves.
+  // So once P reaches 7, a wheel mod 105 skips them.
+  vector<long> multiples_357;
+  for(long i = 0; i < 105; ++i){
+    if(i % 3 == 0 || i % 5 == 0 || i % 7 == 0) multiples_357.push_back(i);
+  }
+  long step;
+
+  // loop over odd pre-products.  P is read from F since the wheel may step by more than 2.
+  for(int64 P = 3; P < B_upper; P = F.currentval){
+    if(P == 7) F.set_wheel(multiples_357);
+
     // check if P is prime.  If not, continue
     if(!F.isprime_current()){
-      F.next();
-      F.next();
+      step = F.next_odd();
 
       // update the P index
-      res_P_index += 2;
-      if(res_P_index > total_residue) res_P_index -= total_residue;
+      res_P_index += step;
+      if(res_P_index >= total_residue) res_P_index -= total_residue;
 
     }else{
       //cout << "Found prime P = " << P << "\n";     
@@ -815,16 +1845,15 @@ void SmallP_Carmichael::tabulate_car_primeP(long processor, long num_threads, st
 
       // if prime count in correct residue class, construct cars
       if(num_prime_P % num_threads != processor){
-        F.next();
-        F.next();
+        step = F.next_odd();
 
         // update the P index
-        res_P_index += 2;
-        if(res_P_index > total_residue) res_P_index -= total_residue;
+        res_P_index += step;
+        if(res_P_index >= total_residue) res_P_index -= total_residue;
 
       }else{
         // construct preproduct object
-        P_ob = Preproduct(P, P_factors, P_factors_len, Pminus_factors, Pminus_factors_len);
+        Preproduct P_ob = Preproduct(P, P_factors, P_factors_len, Pminus_factors, F.prevexp, Pminus_factors_len);
  
         qrs.clear();
         all_DDelta(P_ob);
@@ -835,12 +1864,11 @@ void SmallP_Carmichael::tabulate_car_primeP(long processor, long num_threads, st
         }
  
         // advance window
-        F.next();
-        F.next();
+        step = F.next_odd();
       
         // update the P index
-        res_P_index += 2;
-        if(res_P_index > total_residue) res_P_index -= total_residue;
+        res_P_index += step;
+        if(res_P_index >= total_residue) res_P_index -= total_residue;
       }
     }// end if P prime
 
@@ -857,7 +1885,6 @@ void SmallP_Carmichael::tabulate_car_primeP_crossover(long processor, long num_t
   long   P_factors_len;
   int64* Pminus_factors;
   long   Pminus_factors_len;
-  Preproduct P_ob;
 
   // file stream object
   ofstream output;
@@ -870,16 +1897,25 @@ void SmallP_Carmichael::tabulate_car_primeP_crossover(long processor, long num_t
   // count the number of prime pre-products
   int64 num_prime_P = 0;
 
-  // loop over pre-products
-  for(int64 P = 3; P < B_upper; ++P){
+  // Multiples of 3, 5, 7 can't be prime pre-products, other than 3, 5, 7 themselves.
+  // So once P reaches 7, a wheel mod 105 skips them.
+  vector<long> multiples_357;
+  for(long i = 0; i < 105; ++i){
+    if(i % 3 == 0 || i % 5 == 0 || i % 7 == 0) multiples_357.push_back(i);
+  }
+  long step;
+
+  // loop over odd pre-products.  P is read from F since the wheel may step by more than 2.
+  for(int64 P = 3; P < B_upper; P = F.currentval){
+    if(P == 7) F.set_wheel(multiples_357);
+
     // check if P is prime.  If not, continue
     if(!F.isprime_current()){
-      F.next();
-      F.next();
+      step = F.next_odd();
 
       // update the P index
-      res_P_index += 2;
-      if(res_P_index > total_residue) res_P_index -= total_residue;
+      res_P_index += step;
+      if(res_P_index >= total_residue) res_P_index -= total_residue;
     
     }else{
       //cout << "Found prime P = " << P << "\n";     
@@ -893,16 +1929,15 @@ void SmallP_Carmichael::tabulate_car_primeP_crossover(long processor, long num_t
 
       // if prime count in correct residue class, construct cars
       if(num_prime_P % num_threads != processor){
-        F.next();
-        F.next();
+        step = F.next_odd();
 
         // update the P index
-        res_P_index += 2;
-        if(res_P_index > total_residue) res_P_index -= total_residue;
+        res_P_index += step;
+        if(res_P_index >= total_residue) res_P_index -= total_residue;
       
       }else{
         // construct preproduct object
-        P_ob = Preproduct(P, P_factors, P_factors_len, Pminus_factors, Pminus_factors_len);
+        Preproduct P_ob = Preproduct(P, P_factors, P_factors_len, Pminus_factors, F.prevexp, Pminus_factors_len);
 
         // construct carmichaels with that particular preproduct.
         qrs.clear();
@@ -914,12 +1949,11 @@ void SmallP_Carmichael::tabulate_car_primeP_crossover(long processor, long num_t
         }
  
         // advance window
-        F.next();
-        F.next();
+        step = F.next_odd();
 
         // update the P index
-        res_P_index += 2;
-        if(res_P_index > total_residue) res_P_index -= total_residue;
+        res_P_index += step;
+        if(res_P_index >= total_residue) res_P_index -= total_residue;
       }  
     }// end if P prime
 
@@ -935,103 +1969,226 @@ void SmallP_Carmichael::tabulate_car_primeP_crossover(long processor, long num_t
  * of (P-1)(P+D) for the D-Delta method. 
 */
 void SmallP_Carmichael::preproduct_crossover(Preproduct& P){
-  int64* PplusD;
-  long PplusD_len;
+  // a batch of one.  P's residue is the current res_P_index.
+  vector<Preproduct> batch(1, P);
+  vector<long> batch_residues(1, res_P_index);
+  vector<vector<pair<int64, bigint>>> batch_qrs;
+
+  preproduct_crossover_batch(batch, batch_residues, batch_qrs);
+
+  // Carmichaels are added to qrs, as if completion_check had written them directly
+  qrs.insert(qrs.end(), batch_qrs[0].begin(), batch_qrs[0].end());
+}
+
+/* Crossover for a batch of pre-products in increasing order, sharing one P+D sieve.
+ * For each P the D-Delta method is used for small D and the CD method for the rest, exactly as 
+ * preproduct_crossover does for a single P.  The D-Delta phase needs the factorization of P+D for 
+ * D = 2, 3, ... and these ranges overlap almost completely for nearby P.  So rather than sieve (P, 2P) 
+ * once per P, FD makes a single pass over n starting at P_first + 2, and the factorization of each n 
+ * serves every P in the batch still in its D-Delta phase, with D = n - P.
+ * The CD phase needs no factorizations, so it runs per P after the sweep.
+ * Carmichaels for batch[k] are written to batch_qrs[k], in the order preproduct_crossover would find them.
+ */
+void SmallP_Carmichael::preproduct_crossover_batch(vector<Preproduct>& batch, vector<long>& batch_residues, 
+                                                   vector<vector<pair<int64, bigint>>>& batch_qrs){
+  long batch_len = batch.size();
+  batch_qrs.assign(batch_len, vector<pair<int64, bigint>>());
+  if(batch_len == 0) return;
+
+  // res_P_index and res_D_index are set for each P and D in turn.  The caller may be stepping 
+  // res_P_index along with its own loop over P, so it is restored at the end.
+  long saved_res_P_index = res_P_index;
 
-  // testing
-  //cout << "Running preproduct_crossover with P = " << P.Prod << "\n";
-  
   // For the dynamic version we need L_p, defined by 
   // P^2 + L_p = P^2 (p_{d-2} + 3)/(p_{d-2} + 1), where p_{d-2} is largest prime in P
   // So L_p = P^2 ( (p_{d-2} + 3)/(p_{d-2} + 1) - 1)
   // But we will use the simpler estimation of 2 * P^2 / p_{d-2}
-  int64 L_p = 2 * P.Prod * P.Prod / P.largest_prime();
-
-  // We need a Factgen object for factorizations of P+D
-  // Initialize to match D in [2 .. P-1]
-  FD.init(P.Prod + 2, 2 * P.Prod);
-
-  // count the number of times we do C-D
-  int64 count_CD = 0;
-  bool do_DDelta_method = true;
-  int64 count_DDelta = 0;
-
-  // calculate an estimate for the number of divisors.  Crossover to CD if L_P/D < divisor count
-  int64 divisor_estimate = 1;
+  // D_cross[k] will be the first D where batch[k] crosses over to the CD method, or P if it never does.
+  vector<int64> L_p(batch_len);
+  vector<int64> D_cross(batch_len);
+  for(long k = 0; k < batch_len; ++k){
+    L_p[k] = 2 * batch[k].Prod * batch[k].Prod / batch[k].largest_prime();
+    D_cross[k] = batch[k].Prod;
+  }
 
-  // calling either CD or DDelta method will create Carmichael completions
-  vector<pair<int64, bigint>> qrs;
+  // in_DDelta[k] is true until batch[k] crosses over or runs out of D
+  vector<bool> in_DDelta(batch_len, true);
+  long num_active = batch_len;
 
-  // Note: incomplete idea for only doing crossover in certain situation
-  // if p (largest prime of P) satisfies P/p < 20, do D-Delta unconditionally, no crossover
-  // Note 20 is "magical", just supposed to represent "small"
-  // if(P / largestp >= 20) <then do crossover, i.e. the entire rest of the function>
+  // Initialize to match D in [2 .. P-1] for every P in the batch
+  FD.init(batch[0].Prod + 2, 2 * batch[batch_len - 1].Prod);
 
-  // Basic loop structure: for all D in [2..(P-1)], for all divisors
-  // of the expression (P-1)(P+D)/2, do stuff.
-  //
-  // Initialize D residue and libdivide object
-  res_D_index = 2;
   libdivide::divider<int64> fast_D;
 
-  for(int64 D = 2; D < P.Prod; ++D){
-    fast_D = libdivide::divider<int64>(D);
+  // Basic loop structure: for all D in [2..(P-1)], for all divisors
+  // of the expression (P-1)(P+D)/2, do stuff.  Here D = n - P.
+  for(int64 n = batch[0].Prod + 2; num_active > 0; ++n){
+    // then FD.prev corresponds to n
+    FD.next();
 
-    // Start with code to decide whether to do D-Delta or C-D method
-    // if count_CD > 20, do C-D.  20 chosen without investigation.
-    if(count_CD > 20){
-      do_DDelta_method = false;
-    }else{
-      // if we are in the DDelta method, then turn the FD incremental sieve
-      if(do_DDelta_method){
-        FD.next();
-        // then FD.prev corresponds to P+D
-        PplusD = FD.prev;
-        PplusD_len = FD.prevlen;
+    for(long k = 0; k < batch_len; ++k){
+      if(!in_DDelta[k]) continue;
+      int64 D = n - batch[k].Prod;
+      // later P in the batch have not reached D = 2 yet
+      if(D < 2) break;
+
+      // all D for this P done with D-Delta
+      if(D >= batch[k].Prod){
+        in_DDelta[k] = false;
+        num_active--;
+        continue;
       }
+
       // estimate the number of divisors of (P-1)(P+D).  Recall there are fewer if D = 0 mod p for small p
-      divisor_estimate = P.Tau * pow(2, PplusD_len);
+      int64 divisor_estimate = batch[k].Tau * pow(2, FD.prevlen);
       // correction factor for rebalancing after speeding up DDelta method.  Constant based on experiments.
       divisor_estimate /= 4;
 
-      // in the dynamic case, switch if L_P / D is less than the count of divisors
+      // switch to the CD method if L_P / D is less than the count of divisors
       // Divisor count of P-1 stored in Preproduct class as Tau, then include estimate for P+D divisor count
-      // Need to rebalance.  Try this: for every p with D = 0 mod p, divide divisor count by 2
-      if( L_p / D < divisor_estimate){
-        do_DDelta_method = false;
+      if( L_p[k] / D < divisor_estimate){
+        in_DDelta[k] = false;
+        num_active--;
+        D_cross[k] = D;
+        continue;
       }
-      
-    } // end deciding which method
 
-    // if D is small, do the D-Delta method
-    if(do_DDelta_method){
-      DDelta(P, D, fast_D);
-      
-      // testing
-      //if(qrs.size() > 0) cout << "DDelta method for D = " << D << " found Carmichaels: ";
-      //count_DDelta++;
+      // D-Delta method, with the residues for this P and D.  
+      // The D residue starts at 2 when D = 2 and wraps from total_residue to 1.
+      res_P_index = batch_residues[k];
+      res_D_index = (D - 1) % total_residue + 1;
+      fast_D = libdivide::divider<int64>(D);
+
+      // completion_check writes to qrs, so swap in the list for this P
+      qrs.swap(batch_qrs[k]);
+      DDelta(batch[k], D, fast_D);
+      qrs.swap(batch_qrs[k]);
+    } // end for k
+  } // end for n
+
+  // CD method for the remaining D of each P
+  for(long k = 0; k < batch_len; ++k){
+    res_P_index = batch_residues[k];
+    qrs.swap(batch_qrs[k]);
+    CD_tail(batch[k], D_cross[k], batch[k].Prod);
+    qrs.swap(batch_qrs[k]);
+  }
 
-    } // end if D small
-    else{
+  res_P_index = saved_res_P_index;
+}
 
-      // turn counter and perform CD method
-      count_CD++;
-      CD(P, D, fast_D);
+ 
+
+/* The first D at which preproduct_crossover switches P to the CD method, or P if it never does.
+ * Only the P+D sieve runs, so this is cheap next to the D-Delta work on the same D.
+ */
+int64 SmallP_Carmichael::crossover_point(Preproduct& P){
+  int64 L_p = 2 * P.Prod * P.Prod / P.largest_prime();
 
-      //testing
-      //if(qrs.size() > 0) cout << "CD method for D = " << D << " found Carmichaels: "; 
+  FD.init(P.Prod + 2, 2 * P.Prod);
+  for(int64 D = 2; D < P.Prod; ++D){
+    FD.next();
 
-    } // end if D large i.e. end of else
+    // same test as preproduct_crossover_batch
+    int64 divisor_estimate = P.Tau * pow(2, FD.prevlen);
+    divisor_estimate /= 4;
+    if( L_p / D < divisor_estimate) return D;
+  }
+  return P.Prod;
+}
 
-    // note the Carmichaels are written to vector qrs by completion_check, called by either DDelta or CD
+/* preproduct_crossover restricted to D_start <= D < D_stop, given the crossover point D_cross.
+ * D-Delta is used for D < D_cross, and CD from D_cross on.  FD is initialized at P + D_start, so the 
+ * range needs no sieving below it.  Carmichaels are appended to range_qrs in the order preproduct_crossover
+ * would find them.
+ */
+void SmallP_Carmichael::crossover_D_range(Preproduct& P, long P_residue, int64 D_start, int64 D_stop, 
+                                          int64 D_cross, vector<pair<int64, bigint>>& range_qrs){
+  long saved_res_P_index = res_P_index;
+  res_P_index = P_residue;
+  libdivide::divider<int64> fast_D;
 
-    // update D residue
-    res_D_index++;
-    if(res_D_index > total_residue) res_D_index -= total_residue;
+  // completion_check writes to qrs
+  qrs.swap(range_qrs);
+
+  // D-Delta part
+  int64 DDelta_stop = (D_stop < D_cross) ? D_stop : D_cross;
+  if(D_start < DDelta_stop){
+    FD.init(P.Prod + D_start, P.Prod + DDelta_stop);
+    for(int64 D = D_start; D < DDelta_stop; ++D){
+      FD.next();
+      res_D_index = (D - 1) % total_residue + 1;
+      fast_D = libdivide::divider<int64>(D);
+      DDelta(P, D, fast_D);
+    }
+  }
 
-  } // end for D
-  //cout << "Crossover with P = " << P.Prod << " did DDelta method " << count_DDelta << " times and the CD method " << count_CD << " many times\n";
- 
+  // CD part
+  int64 CD_start = (D_start > D_cross) ? D_start : D_cross;
+  if(CD_start < D_stop) CD_tail(P, CD_start, D_stop);
+
+  qrs.swap(range_qrs);
+  res_P_index = saved_res_P_index;
 }
 
- 
+/* preproduct_crossover for a single large P, with the D range [2, P) split among num_parts threads.
+ * The crossover point is found first, then the range is cut into pieces of about equal estimated work, 
+ * counted in steps of the C loop in CD.  A CD step at D takes L_p / D of them, the length of its C interval, 
+ * and a D-Delta step takes about what a CD step takes at the crossover, L_p / D_cross.  Every D also has 
+ * a fixed cost (the divider, bounds, residues), which timings near P = 2*10^6 put at about 8 C steps.
+ * Each piece runs in its own SmallP_Carmichael context, with its own FD sieve and residue indices.
+ * The pieces are merged in order of D, so qrs ends up as preproduct_crossover would leave it.
+ * The shared prime base must already cover P+D (see prepare_shared_tables).
+ */
+void SmallP_Carmichael::preproduct_crossover_split(Preproduct& P, long num_parts){
+  if(num_parts < 1) num_parts = 1;
+  int64 D_cross = crossover_point(P);
+
+  double L_p = 2.0 * P.Prod * P.Prod / P.largest_prime();
+  double per_D = 8;
+  double step = L_p / D_cross + per_D;
+
+  // estimated work for D in [2, D_end)
+  auto work_below = [&](int64 D_end){
+    if(D_end <= D_cross) return step * (D_end - 2);
+    return step * (D_cross - 2) + L_p * log((double)D_end / D_cross) + per_D * (D_end - D_cross);
+  };
+  double total_work = work_below(P.Prod);
+
+  // cut points, found by bisection since the work is increasing in D
+  vector<int64> cuts(num_parts + 1);
+  cuts[0] = 2;
+  cuts[num_parts] = P.Prod;
+  for(long i = 1; i < num_parts; ++i){
+    double target = total_work * i / num_parts;
+    int64 lo = cuts[i - 1];
+    int64 hi = P.Prod;
+    while(lo < hi){
+      int64 mid = lo + (hi - lo) / 2;
+      if(work_below(mid) < target) lo = mid + 1;
+      else hi = mid;
+    }
+    cuts[i] = lo;
+  }
+
+  // one context per piece
+  long P_residue = P.Prod % total_residue;
+  vector<vector<pair<int64, bigint>>> part_qrs(num_parts);
+  auto work = [&](long i){
+    if(pin_workers) pin_worker(i);
+    SmallP_Carmichael context = SmallP_Carmichael(B_lower, B_upper, X, bounded_cars);
+    context.copy_tuning(*this);
+    Preproduct P_copy = Preproduct(P);
+    context.crossover_D_range(P_copy, P_residue, cuts[i], cuts[i + 1], D_cross, part_qrs[i]);
+  };
+
+  vector<thread> workers;
+  for(long i = 0; i < num_parts; ++i){
+    if(cuts[i] < cuts[i + 1]) workers.push_back(thread(work, i));
+  }
+  for(long w = 0; w < workers.size(); ++w) workers[w].join();
+
+  for(long i = 0; i < num_parts; ++i){
+    qrs.insert(qrs.end(), part_qrs[i].begin(), part_qrs[i].end());
+  }
+}
@@ -11,6 +11,10 @@
 #include "functions.h"
 #include "Factgen.h"
 #include "Preproduct.h"
+#include "PreproductSource.h"
+#include "BoundedQueue.h"
+#include "Checkpoint.h"
+#include "Placement.h"
 #include "int.h"
 #include "bigint.h"
 #include "libdivide.h"
@@ -23,6 +27,13 @@
 #include <fstream>
 #include <sstream>
 #include <math.h>
+#include <cstring>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <map>
+#include <chrono>
+#include <unistd.h>
 
 
 using namespace std;
@@ -36,8 +47,11 @@ class SmallP_Carmichael{
     // Object for the incremental sieve
     Factgen2 F;
 
-    // Object for the P+D sieve
-    Factgen FD;
+    // Object for the P+D sieve.  Block version, so the factorizations of P+D are sieved a segment at a time
+    FactgenBlock FD;
+
+    // Sieve that crosses off inadmissable pre-products, so most P never get a Preproduct object
+    AdmissableSieve A;
 
     // Unfortunately B and X are reversed in the paper.  Mistake I made early in development.
     // preproduct upper_bound and lower bound.  Initialization value for F.
@@ -54,6 +68,10 @@ class SmallP_Carmichael{
     // variable that stores (P - 1) * (P + D) / 2.  Used to test integrality of q for a given Delta
     int64 q_D;
 
+    // divisors of q_D in [Delta_lower, Delta_bound), filled by Odometer::divisors_between in DDelta.  Kept here 
+    // so its storage is reused from one D to the next.
+    vector<int64> bounded_divs;
+
     // Data structures for an integrality optimization:
     // C = (P^2 + Delta)/D has to be an integer.  So if p | D, there are mod p restrictions on P, Delta
     // Currently only implemented for the primes 2, 3, 5, 7.  
@@ -63,6 +81,37 @@ class SmallP_Carmichael{
     long residues_D[210][4];
     long res_P_index;
     long res_D_index;
+
+    // DDelta switches to DDelta_residue when (P-1)(P+D)/2 has at least this many divisors
+    long residue_divisor_min;
+
+    // if true, CD tests q_D % Delta by carrying the quotient from one C to the next instead of dividing.
+    // See CD_incremental.
+    bool incremental_CD;
+
+    // if true, CD_tail tests blocks of CD_lanes consecutive D together in doubles, see CD_tail
+    bool block_CD;
+    static const long CD_lanes = 8;
+
+    // number of pre-products tabulate_car passes to preproduct_crossover_batch at a time
+    long crossover_batch;
+
+    // if more than 1, tabulate_car splits the D range of each P >= min_split_P among this many threads
+    long crossover_threads;
+    static const int64 min_split_P = 65536;
+
+    // if true, the worker threads of tabulate_car_threaded, tabulate_car_pipeline and preproduct_crossover_split 
+    // are pinned to CPUs spread over the NUMA nodes, and build their contexts after pinning (see Placement.h)
+    bool pin_workers;
+
+    // if true, completion_check skips the primality tests on q and r and keeps every (q, r) passing Korselt.
+    // Used by the construction stage of tabulate_car_staged, whose primality stage does the tests.
+    bool defer_primality;
+
+    // if not empty, tabulate_car, tabulate_car_interval and tabulate_car_threaded save their progress here 
+    // every checkpoint_seconds, and resume from it when restarted on the same job.  See Checkpoint.h
+    string checkpoint_file;
+    double checkpoint_seconds;
  
   public:
     // stores pairs (q, r) that complete a Carmichael of the form Pqr
@@ -72,6 +121,9 @@ class SmallP_Carmichael{
     // default sets B to 2^(16)
     SmallP_Carmichael();
 
+    // copy crossover_batch, residue_divisor_min, incremental_CD and block_CD from other, e.g. into a worker's context
+    void copy_tuning(const SmallP_Carmichael& other);
+
     // set preproduct bounds and Carmichael bound.  Initialize F.  FD gets initialized in a separate function.
     SmallP_Carmichael(int64 B_low_val, int64 B_up_val, bigint X_val, bool bounded);
 
@@ -103,10 +155,40 @@ class SmallP_Carmichael{
      */  
     void DDelta(Preproduct& P, bigint D, libdivide::divider<int64>& fastD);
 
+    /* The divisor loop of DDelta, given the factorization of q_D it builds, but only over divisors Delta with 
+     * Delta = -P^2 mod D, the ones for which C is integral.  Found by meeting in the middle: the divisors of 
+     * each half of the primes are listed, and pairs whose product is in the right class mod D are matched.
+     * Same Carmichaels, in the same order, as the Odometer loop in DDelta.
+     */
+    void DDelta_residue(Preproduct& P, int64 D, libdivide::divider<int64>& fastD, int64* q_primes, long* q_exps, 
+                        long q_primes_len, int64 divisor_multiple, int64 Delta_min, int64 Delta_bound);
+
+    /* Least Delta worth trying for this P, D: below it, Pqr >= X in bounded mode.  1 when not bounded.
+     * Used by DDelta and CD to skip the small Delta, which are where completion_check would otherwise 
+     * spend its 128-bit arithmetic on r for nothing.
+     */
+    int64 Delta_lower(Preproduct& P, int64 D);
+
+    /* Keep only the Delta in Deltas for which C = (P^2 + Delta)/D is an integer, in the same order.  
+     * Divides a block of Delta at a time in vector registers, rather than one per completion_check.
+     */
+    void filter_C_integral(int64 P2, int64 D, libdivide::divider<int64>& fastD, vector<int64>& Deltas);
+    static const long filter_lanes = 8;
+
     /* Given a Preproduct and a D value, compute all Carmichael numbers.  This algorithm due to Pinch
      */
     void CD(Preproduct& P, bigint D, libdivide::divider<int64>& fastD); 
 
+    /* The loop over C in [C_lower, C_upper] of CD, with the divisibility of q_D by Delta followed 
+     * incrementally rather than by a divide per C.  CD calls it when incremental_CD is set.
+     */
+    void CD_incremental(Preproduct& P, int64 D, libdivide::divider<int64>& fastD, int64 C_lower, int64 C_upper);
+
+    /* CD for all D in [D_start, D_stop), the part of the crossover after P switches from D-Delta.  Carmichaels 
+     * are written to qrs in the same order as calling CD for each D in turn.
+     */
+    void CD_tail(Preproduct& P, int64 D_start, int64 D_stop);
+
   /* Once I have the loop over divisors of (P-1)(P+D)/Delta, I need to perform the following steps:
     1) Compute C = (P^2 + Delta)/D, check that it is integral (unless C != 0, meaning given as parameter)
     2) Check Pqr for Korselt criterion: L | Pqr - 1
@@ -118,6 +200,9 @@ class SmallP_Carmichael{
   If completion works, returns true and writes pair (q,r) to the qrs vector.  If it doesn't, returns false.
   */
     bool completion_check(Preproduct& P, int64 Delta, int64 D, libdivide::divider<int64>& D_div, int64 C_param = 0);
+
+    // Baillie-PSW on q_val and r_val, using q_big and r_big as scratch.  True if both are probable primes.
+    bool prime_pair(int64 q_val, bigint r_val, mpz_t q_big, mpz_t r_big);
    
   /* Construct Carmichaels for a range of pre-products P
  *   We use a factgen2 object, write to a file.  Only process admissable pre-products, divide up work among
@@ -131,6 +216,66 @@ class SmallP_Carmichael{
  */
     void tabulate_car(long processor, long num_threads, string cars_file, bool verbose_output);
 
+    /* Same as tabulate_car, restricted to pre-products P in [start_val, stop_val) intersected with [B_lower, B_upper).
+ *   F is initialized at start_val, so a job given one interval never sieves P outside it.  
+ *   With processor 0 of 1, the output file is identical to the corresponding slice of a serial run.
+ *   Checkpoints and resumes if checkpoint_file is set.
+ */
+    void tabulate_car_interval(int64 start_val, int64 stop_val, long processor, long num_threads, 
+                               string cars_file, bool verbose_output);
+
+    /* Same as tabulate_car, but pre-products come from an initialized source, either the incremental sieve 
+ *   or the backtracking search (see PreproductSource.h).  Useful for timing one source against the other.
+ */
+    void tabulate_car_source(PreproductSource& source, long processor, long num_threads, 
+                             string cars_file, bool verbose_output);
+
+    // same, but writes to an output stream rather than a file.  Saves progress to checkpoint if given.
+    // Returns the count of admissable pre-products, starting from the checkpoint's if given.
+    int64 tabulate_car_stream(PreproductSource& source, long processor, long num_threads, 
+                             ostream& output, bool verbose_output, Checkpoint* checkpoint = nullptr);
+
+    // open cars_file for job.  If checkpoint_file holds a checkpoint for the same job, job becomes that 
+    // checkpoint and cars_file is cut back to its offset.  Returns false if cars_file can't be cut back.
+    bool open_checkpointed(Checkpoint& job, ofstream& output);
+
+    // flush output and write checkpoint_file, recording that all P < next_P are done
+    void save_checkpoint(Checkpoint& checkpoint, int64 next_P, int64 num_admissable, ostream& output);
+
+    /* Same as tabulate_car, run by num_workers threads in this process.  Each worker has its own 
+ *   SmallP_Carmichael context and claims contiguous chunks of pre-products, most expensive chunk first
+ *   within each window of chunks according to preproduct_cost.  The output file is identical to a serial 
+ *   run, and is written chunk by chunk in order, with checkpoints as in tabulate_car_interval.
+ */
+    void tabulate_car_threaded(long num_workers, string cars_file, bool verbose_output);
+
+    // Estimated time for preproduct_crossover on P, built from L_p, P, and Tau.  Units are arbitrary.
+    double preproduct_cost(Preproduct& P);
+
+    // Cut [start_val, stop_val) into chunks holding per_chunk working pre-products each.  
+    // Chunk c is [bounds[c], bounds[c+1]), and costs[c] is the sum of preproduct_cost over it.
+    void cost_profile(int64 start_val, int64 stop_val, long per_chunk, vector<int64>& bounds, vector<double>& costs);
+
+    // num_parts + 1 boundaries splitting [start_val, stop_val) into intervals of about equal estimated cost
+    vector<int64> cost_balanced_bounds(int64 start_val, int64 stop_val, long num_parts);
+
+    /* Same again, but the incremental sieve runs once, in the calling thread, which pushes batches of 
+ *   admissable pre-products onto a lock-free queue.  num_workers threads pop the batches and construct 
+ *   the Carmichaels.  The output file is identical to a serial run.
+ */
+    void tabulate_car_pipeline(long num_workers, string cars_file, bool verbose_output);
+
+    /* The pipeline again, with every step of the work a stage of its own, connected by bounded queues:
+ *   sieve (the calling thread) -> admissability and Preproduct construction -> D loop -> primality of q, r 
+ *   -> output (one thread).  Stages other than the sieve and output have the thread counts given.  
+ *   The output file is identical to a serial run.
+ */
+    void tabulate_car_staged(long admissable_threads, long construction_threads, long primality_threads, 
+                             string cars_file, bool verbose_output);
+
+    // extend the shared prime base up front, so that threads only ever read it
+    void prepare_shared_tables();
+
     /* Construct Carmichaels for prime pre-products P.  Similar to tabulate_car
  *     Note this only does D-Delta.  Thus bad for production; only use for timing comparisons with Pinch
  * */
@@ -148,6 +293,33 @@ class SmallP_Carmichael{
   */
     void preproduct_crossover(Preproduct& P);
 
+  /* Crossover for a batch of pre-products, given in increasing order with their residues modulo total_residue.
+   * Same result as preproduct_crossover on each, but the factorizations of P+D come from a single 
+   * sweep of FD shared by the whole batch, rather than one sieve of (P, 2P) per pre-product.
+   * Carmichaels for batch[k] are written as (q,r) pairs to batch_qrs[k].
+   */
+    void preproduct_crossover_batch(vector<Preproduct>& batch, vector<long>& batch_residues, 
+                                    vector<vector<pair<int64, bigint>>>& batch_qrs);
+
+  /* The first D at which preproduct_crossover switches from the D-Delta method to the CD method for P.
+   * Returns P if it never switches.
+   */
+    int64 crossover_point(Preproduct& P);
+
+  /* preproduct_crossover on the D in [D_start, D_stop) only, with P residue P_residue and crossover at D_cross.
+   * Carmichaels found are appended to range_qrs.
+   */
+    void crossover_D_range(Preproduct& P, long P_residue, int64 D_start, int64 D_stop, int64 D_cross, 
+                           vector<pair<int64, bigint>>& range_qrs);
+
+  /* Same result as preproduct_crossover, with the D range split among num_parts threads.  Meant for the 
+   * largest P, where a single pre-product can hold up the end of a run.  Carmichaels are added to qrs.
+   */
+    void preproduct_crossover_split(Preproduct& P, long num_parts);
+
+    /* print Carmichaels P q r to output, in the format chosen by verbose_output (see tabulate_car) */
+    void write_cars(ostream& output, Preproduct& P_ob, vector<pair<int64, bigint>>& cars, mpz_t n, bool verbose_output);
+
     /* prints out admissable pre-products in a given range */
     //void find_admissable(int64 low, int64 high);
 
@@ -0,0 +1,83 @@
+/* Work-stealing task pool, for traversing trees whose subtrees vary wildly in size.
+   Written by Andrew Shallue, part of Tabulating Carmichaels project.
+
+   Each worker has its own deque of tasks.  A worker pushes the tasks it creates onto the back of its
+   own deque and pops from the back, so it works depth first on what it has just split off.  A worker
+   whose deque is empty steals from the front of another worker's deque, where the oldest and so
+   usually the largest tasks are.
+
+   Each deque is behind its own mutex.  Tasks here are whole subtrees, so a lock per push or pop costs
+   nothing next to the work, and only thieves ever contend with the owner.
+
+   pending counts tasks pushed and not yet finished.  A worker calls finish after running a task,
+   having pushed any tasks it split off first, so pending only reaches 0 once every task is done.
+*/
+
+#ifndef WORKSTEALING_H
+#define WORKSTEALING_H
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+using namespace std;
+
+template <class T>
+class WorkStealing
+{
+private:
+  vector<deque<T>> deques;
+  vector<mutex> locks;
+  atomic<long> pending;
+
+public:
+  WorkStealing(long num_workers) : deques(num_workers), locks(num_workers)
+  {
+    pending.store(0);
+  }
+
+  // not copyable, the mutexes and counter are shared state
+  WorkStealing(const WorkStealing& other) = delete;
+  WorkStealing& operator=(const WorkStealing& other) = delete;
+
+  void push(long w, const T& task)
+  {
+    pending++;
+    lock_guard<mutex> guard(locks[w]);
+    deques[w].push_back(task);
+  }
+
+  // take a task for worker w: its own newest, or else the oldest of the first other worker that has one.
+  // Returns false if every deque is empty right now.
+  bool pop(long w, T& task)
+  {
+    {
+      lock_guard<mutex> guard(locks[w]);
+      if(deques[w].size() > 0){
+        task = deques[w].back();
+        deques[w].pop_back();
+        return true;
+      }
+    }
+    long n = deques.size();
+    for(long k = 1; k < n; ++k){
+      long victim = (w + k) % n;
+      lock_guard<mutex> guard(locks[victim]);
+      if(deques[victim].size() > 0){
+        task = deques[victim].front();
+        deques[victim].pop_front();
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // a task taken with pop is done
+  void finish()  { pending--; }
+
+  // true once every task pushed has finished
+  bool done()    { return pending.load() == 0; }
+};
+
+#endif
@@ -11,21 +11,59 @@
 #include "Odometer.h"
 #include "bigint.h"
 #include "Pinch.h"
+#include "Manifest.h"
+#include "Placement.h"
 #include <chrono>
 
 using namespace std::chrono;
 
 
 // expecting two arguments: 1) thread number for this instance, 2) total thread count
+// optional third argument "interval": instead of taking every num_threads-th admissable pre-product,
+// this instance takes one contiguous slice of pre-products, so it only sieves its own slice.
+// optional third argument "threads": this one process does the whole tabulation with num_threads threads.
+// optional third argument "pipeline": same, but one sieve feeds num_threads worker threads through a queue.
+// optional third argument "split": pre-products run one at a time, each large P split over num_threads threads by D.
+// optional third argument "staged": a pipeline of sieve, admissability, construction, primality and output stages,
+// with num_threads threads on construction and a quarter as many on each of admissability and primality.
+// Or three arguments "manifest <file> <task>": do the pre-product intervals the manifest lists for this task
+// (see Manifest.h, and the plan executable which writes manifests).
+// Any of these may be added at the end: "pin" pins worker threads to CPUs spread over the NUMA nodes,
+// "thp" backs large sieve buffers with transparent huge pages, "hugetlb" with reserved huge pages (see Placement.h).
 int main(int argc, char* argv[]) {
   std::cout << "Hello World! argc has value " << argc << "\n";
 
+  // placement options come last, take them off before reading the rest
+  bool pin_workers = false;
+  while(argc > 1){
+    string option = argv[argc - 1];
+    if(option == "pin") pin_workers = true;
+    else if(option == "thp") set_huge_pages(HUGE_PAGES_TRANSPARENT);
+    else if(option == "hugetlb") set_huge_pages(HUGE_PAGES_EXPLICIT);
+    else break;
+    cout << "Placement option " << option << "\n";
+    argc--;
+  }
+
   long thread = 0;
   long num_threads = 1;
+  bool by_interval = false;
+  bool by_threads = false;
+  bool by_pipeline = false;
+  bool by_split = false;
+  bool by_staged = false;
+  bool by_manifest = false;
+  string manifest_file;
   string cars_file = "cars_new.txt";
   string none_file = "cars_none.txt"; 
  
-  if(argc == 3){
+  if(argc == 4 && string(argv[1]) == "manifest"){
+    by_manifest = true;
+    manifest_file = argv[2];
+    thread = atoi(argv[3]);
+    cars_file = "cars_million_threads" + to_string(thread) + ".txt";
+    cout << "This is task " << thread << " of manifest " << manifest_file << "\n";
+  }else if(argc == 3 || argc == 4){
     cout << "Two arguments given\n";
     cout << "Argument 1: " << argv[1] << "\n";
     cout << "Argument 2: " << argv[2] << "\n";
@@ -40,6 +78,30 @@ int main(int argc, char* argv[]) {
     
     cout << "This is thread " << thread << " of " << num_threads << "total\n";
   }
+  if(argc == 4 && !by_manifest){
+    by_interval = (string(argv[3]) == "interval");
+    by_threads = (string(argv[3]) == "threads");
+    by_pipeline = (string(argv[3]) == "pipeline");
+    by_split = (string(argv[3]) == "split");
+    by_staged = (string(argv[3]) == "staged");
+    if(by_interval) cout << "Splitting pre-products into contiguous intervals\n";
+    if(by_threads){
+      cout << "Running " << num_threads << " threads in this process\n";
+      cars_file = "cars_million_threaded.txt";
+    }
+    if(by_pipeline){
+      cout << "Running a sieve thread feeding " << num_threads << " worker threads\n";
+      cars_file = "cars_million_threaded.txt";
+    }
+    if(by_split){
+      cout << "Splitting the D range of each large pre-product over " << num_threads << " threads\n";
+      cars_file = "cars_million_threaded.txt";
+    }
+    if(by_staged){
+      cout << "Running a staged pipeline with " << num_threads << " construction threads\n";
+      cars_file = "cars_million_threaded.txt";
+    }
+  }
 
   // timing code from geeksforgeeks.org
   
@@ -56,14 +118,52 @@ int main(int argc, char* argv[]) {
   long X = 70000000;
   // constructor has lower and upper preproduct bounds, then carmichael bound, then bounded boolean
   SmallP_Carmichael C = SmallP_Carmichael(3, X, bound, false);
+  C.pin_workers = pin_workers;
   //Construct_car C = Construct_car();
 
   auto start_new = high_resolution_clock::now();
 
   //C.tabulate_car(bound, 0, 1, "cars0.txt", "cars_none0.txt");
   cout << "starting tabulation\n";
+  // tabulate_car, tabulate_car_interval and tabulate_car_threaded save progress, and a rerun of the same job 
+  // after a kill resumes from it
+  C.checkpoint_file = cars_file + ".ckpt";
   // use appropriate thread, write to cars_file, set output to verbose, i.e. identical to Pinch
-  C.tabulate_car(thread, num_threads, cars_file, true);
+  if(by_manifest){
+    Manifest M;
+    if(M.read(manifest_file)){
+      vector<ManifestEntry> pieces = M.for_task(thread, "P", 0);
+      for(long k = 0; k < pieces.size(); ++k){
+        cout << "pre-products in [" << pieces[k].start << ", " << pieces[k].stop << ")\n";
+        string piece_file = (pieces.size() == 1) ? cars_file : cars_file + "." + to_string(k);
+        // each piece has its own checkpoint, so finished pieces are still recognized after a kill
+        C.checkpoint_file = piece_file + ".ckpt";
+        C.tabulate_car_interval(pieces[k].start, pieces[k].stop, 0, 1, piece_file, true);
+      }
+    }
+  }else if(by_threads){
+    C.tabulate_car_threaded(num_threads, cars_file, true);
+  }else if(by_pipeline){
+    C.tabulate_car_pipeline(num_threads, cars_file, true);
+  }else if(by_staged){
+    long side_threads = (num_threads + 3) / 4;
+    C.tabulate_car_staged(side_threads, num_threads, side_threads, cars_file, true);
+  }else if(by_split){
+    C.crossover_threads = num_threads;
+    C.tabulate_car(0, 1, cars_file, true);
+  }else if(by_interval){
+    // thread numbers from SGE start at 1, slices are numbered from 0.
+    // Equal width, so no job looks at P outside its slice.  For slices of equal estimated cost, 
+    // write a manifest once with "plan small" and run each task with "manifest <file> <task>".
+    long slice = thread % num_threads;
+    int64 width = (X - 3) / num_threads;
+    int64 slice_start = 3 + slice * width;
+    int64 slice_stop = (slice == num_threads - 1) ? X : slice_start + width;
+    cout << "pre-products in [" << slice_start << ", " << slice_stop << ")\n";
+    C.tabulate_car_interval(slice_start, slice_stop, 0, 1, cars_file, true);
+  }else{
+    C.tabulate_car(thread, num_threads, cars_file, true);
+  }
 
   auto end_new = high_resolution_clock::now();
  
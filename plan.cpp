@@ -0,0 +1,163 @@
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <cstdio>
+#include "math.h"
+#include "functions.h"
+#include "SmallP_Carmichael.h"
+#include "LargePreproduct.h"
+#include "Manifest.h"
+#include "bigint.h"
+#include <chrono>
+
+using namespace std::chrono;
+
+/* Planning executable for array jobs.  Estimates the cost of a tabulation, splits it into num_tasks
+ * pieces of about equal cost, and writes them to a manifest (see Manifest.h).  Entries of the kind
+ * being planned are replaced, others already in the manifest are kept, so the small and large cases
+ * can be planned into the same file.
+ *
+ *   plan small <B_lower> <B_upper> <num_tasks> <manifest> [X]
+ *     Pre-product intervals for tabulate.  Every pre-product in [B_lower, B_upper) is priced with
+ *     SmallP_Carmichael::preproduct_cost.  If X is given, the tabulation is bounded: P p^2 < X.
+ *
+ *   plan large <B> <X> <num_tasks> <manifest> <d_low> <d_high> [stride]
+ *     Prefix count ranges for tab_serial, for each d from d_low to d_high.  Every stride-th prefix
+ *     is timed, and each timing stands in for the stride prefixes around it.  The d = 4 case splits
+ *     by p1 rather than by prefix count: task t gets the p1 of index t mod num_tasks (kind p1), priced
+ *     by timing every stride-th p1.
+ *     Sampling does about 1/stride of the whole large tabulation on one core, so the default stride is 
+ *     1024.  A smaller stride only pays when some d has fewer than a few times 1024 num_tasks prefixes, 
+ *     since the cuts between tasks fall on multiples of stride.
+ *
+ * Written by Andrew Shallue, part of the Tabulating Carmichaels project
+ */
+
+// cut the costs of consecutive pieces into num_tasks runs of about equal total.  Returns num_tasks + 1
+// indices into costs: task t gets pieces cuts[t] <= i < cuts[t+1].
+vector<long> balance(vector<double>& costs, long num_tasks){
+  double total = 0;
+  for(long i = 0; i < costs.size(); ++i) total += costs[i];
+
+  vector<long> cuts(1, 0);
+  double running = 0;
+  for(long i = 0; i < costs.size() && cuts.size() < num_tasks; ++i){
+    running += costs[i];
+    while(cuts.size() < num_tasks && running >= total * cuts.size() / num_tasks) cuts.push_back(i + 1);
+  }
+  while(cuts.size() < num_tasks) cuts.push_back(costs.size());
+  cuts.push_back(costs.size());
+  return cuts;
+}
+
+void plan_small(int64 B_lower, int64 B_upper, long num_tasks, bigint X, bool bounded, Manifest& M){
+  SmallP_Carmichael C = SmallP_Carmichael(B_lower, B_upper, X, bounded);
+
+  int64 start_P = (B_lower % 2 == 0) ? B_lower + 1 : B_lower;
+  vector<int64> bounds;
+  vector<double> costs;
+  C.cost_profile(start_P, B_upper, C.crossover_batch, bounds, costs);
+
+  vector<long> cuts = balance(costs, num_tasks);
+  for(long t = 0; t < num_tasks; ++t){
+    double cost = 0;
+    for(long i = cuts[t]; i < cuts[t + 1]; ++i) cost += costs[i];
+    M.add(t, "P", 0, bounds[cuts[t]], bounds[cuts[t + 1]], cost);
+  }
+}
+
+void plan_large(bigint B, long X, long num_tasks, long d_low, long d_high, long stride, Manifest& M){
+  LargePreproduct C = LargePreproduct(B, X);
+  string sample_file = "plan_sample.txt";
+
+  for(long d = d_low; d <= d_high; ++d){
+    if(d == 4){
+      // time every stride-th p1, and give each task an equal share
+      auto sample_start = steady_clock::now();
+      C.cars4_threaded(sample_file, 0, stride);
+      duration<double> elapsed = steady_clock::now() - sample_start;
+      for(long t = 0; t < num_tasks; ++t) M.add(t, "p1", 4, t, num_tasks, elapsed.count() * stride / num_tasks);
+      cout << "d = 4: sampled in " << elapsed.count() << " seconds\n";
+      continue;
+    }
+
+    // time every stride-th prefix
+    C.prefix_ranges.clear();
+    C.prefix_times.clear();
+    C.prefix_total = 0;
+    C.time_prefixes = true;
+    C.prefix_clock_start = steady_clock::now();
+    C.cars_threaded(d, sample_file, 0, stride);
+    duration<double> elapsed = steady_clock::now() - C.prefix_clock_start;
+    C.time_prefixes = false;
+
+    // Each timed prefix runs until the next one starts.  Its time is spread over the stride prefixes
+    // it stands for, so costs[i] is the estimate for prefix counts [i * stride, (i+1) * stride).
+    long num_pieces = (C.prefix_total + stride - 1) / stride;
+    vector<double> costs(num_pieces, 0);
+    for(long k = 0; k < C.prefix_times.size(); ++k){
+      double end = (k + 1 < C.prefix_times.size()) ? C.prefix_times[k + 1].second : elapsed.count();
+      costs[C.prefix_times[k].first / stride] = end - C.prefix_times[k].second;
+    }
+
+    vector<long> cuts = balance(costs, num_tasks);
+    for(long t = 0; t < num_tasks; ++t){
+      double cost = 0;
+      for(long i = cuts[t]; i < cuts[t + 1]; ++i) cost += costs[i] * stride;
+      int64 first = cuts[t] * stride;
+      int64 last = (cuts[t + 1] == num_pieces) ? C.prefix_total : cuts[t + 1] * stride;
+      M.add(t, "prefix", d, first, last, cost);
+    }
+    cout << "d = " << d << ": " << C.prefix_total << " prefixes, sampled in " << elapsed.count() << " seconds\n";
+  }
+  remove(sample_file.c_str());
+}
+
+int main(int argc, char* argv[]) {
+  if(argc < 6){
+    cout << "usage: plan small <B_lower> <B_upper> <num_tasks> <manifest> [X]\n";
+    cout << "       plan large <B> <X> <num_tasks> <manifest> <d_low> <d_high> [stride]\n";
+    return 1;
+  }
+  string mode = argv[1];
+  long num_tasks = atol(argv[4]);
+  string manifest_file = argv[5];
+
+  // keep what is already planned, except the kind being planned now
+  Manifest M;
+  ifstream existing(manifest_file);
+  if(existing.good()){
+    existing.close();
+    M.read(manifest_file);
+  }
+
+  auto start = high_resolution_clock::now();
+
+  if(mode == "small"){
+    int64 B_lower = atoll(argv[2]);
+    int64 B_upper = atoll(argv[3]);
+    bool bounded = (argc >= 7);
+    bigint X = bounded ? (bigint)atoll(argv[6]) : 0;
+
+    M.remove_kind("P");
+    plan_small(B_lower, B_upper, num_tasks, X, bounded, M);
+  }else if(mode == "large" && argc >= 8){
+    bigint B = atoll(argv[2]);
+    long X = atol(argv[3]);
+    long d_low = atol(argv[6]);
+    long d_high = atol(argv[7]);
+    long stride = (argc >= 9) ? atol(argv[8]) : 1024;
+
+    M.remove_kind("prefix");
+    M.remove_kind("p1");
+    plan_large(B, X, num_tasks, d_low, d_high, stride, M);
+  }else{
+    cout << "plan: unknown mode or missing arguments\n";
+    return 1;
+  }
+
+  M.write(manifest_file);
+
+  auto end = high_resolution_clock::now();
+  cout << "planning took " << duration_cast<seconds>(end - start).count() << " seconds\n";
+}
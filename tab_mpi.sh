@@ -1,6 +1,7 @@
 #!/bin/sh
 
-# This script runs tab_parallel function, which uses mpi 
+# This script runs tab_parallel, which used to use mpi.  It now runs its own worker processes 
+# and shares a manifest of work with any other tab_parallel running on the same work directory.
 # Script written by Andrew Shallue, Feb 2022, based on a script by Mark Liffiton
 
 # email address for notifications
@@ -12,13 +13,13 @@
 # limit walltime
 ##$ -l h_rt=00:01:00
 
-# creation of MPI parallel environment
-#$ -pe mpi 4
+# cores on one machine.  For several machines, submit this script once per machine.
+#$ -pe smp 4
 
 # change directory
 cd ~ashallue/tabulate_car
 
-# run command
-mpiexec ./tab_parallel
+# run command.  manifest.txt comes from plan, e.g. ./plan small 3 70000000 256 manifest.txt
+./tab_parallel manifest.txt tab_parallel_work 4
 
 
@@ -0,0 +1,91 @@
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include "math.h"
+#include "functions.h"
+#include "SmallP_Carmichael.h"
+#include "LargePreproduct.h"
+#include "Manifest.h"
+#include "Coordinator.h"
+#include "Placement.h"
+#include "bigint.h"
+#include <chrono>
+
+using namespace std::chrono;
+
+/* Multi-process tabulation without MPI.  Runs a Coordinator (see Coordinator.h) over the units of a 
+ * manifest written by plan: pre-product intervals (kind P) go to SmallP_Carmichael, prefix ranges 
+ * (kind prefix) and the d = 4 split by p1 (kind p1) to LargePreproduct.  Start one of these on each machine, all with the same manifest and
+ * a work directory on a shared filesystem, and they divide the units among themselves.
+ *
+ * The bounds match main.cpp (small case) and tab_serial.cpp (large case).
+ * Written by Andrew Shallue, part of the Tabulating Carmichaels project
+ */
+
+// expecting three arguments: manifest file, work directory, number of worker processes on this machine.
+// Optional fourth argument: seconds after which another machine's claim on a unit is considered dead.
+// Placement options may follow, as for tabulate: "pin", "thp", "hugetlb" (see Placement.h).
+int main(int argc, char* argv[]) {
+  bool pin_workers = false;
+  while(argc > 4){
+    string option = argv[argc - 1];
+    if(option == "pin") pin_workers = true;
+    else if(option == "thp") set_huge_pages(HUGE_PAGES_TRANSPARENT);
+    else if(option == "hugetlb") set_huge_pages(HUGE_PAGES_EXPLICIT);
+    else break;
+    argc--;
+  }
+
+  if(argc != 4 && argc != 5){
+    cout << "usage: tab_parallel <manifest> <work_dir> <num_workers> [lease_seconds] [pin] [thp | hugetlb]\n";
+    return 1;
+  }
+  string manifest_file = argv[1];
+  string work_dir = argv[2];
+  long num_workers = atol(argv[3]);
+
+  // small case, as in main: pre-products up to 7*10^7, unbounded
+  bigint num_millions = 10000000000000000;
+  bigint small_bound = num_millions * 1000000;
+  int64 small_X = 70000000;
+
+  // large case, as in tab_serial: Carmichaels up to 10^18, large pre-products above B^{1/3}
+  bigint num_millions_upper = 1000000000000;
+  bigint large_bound = num_millions_upper * 1000000;
+  bigint large_X = ceil(pow(large_bound, 1.0 / 3));
+
+  // Each worker process builds the objects it needs on its first unit and keeps them
+  SmallP_Carmichael* small = nullptr;
+  LargePreproduct* large = nullptr;
+
+  auto run_unit = [&](ManifestEntry& e, string output_file){
+    if(e.kind == "P"){
+      if(small == nullptr) small = new SmallP_Carmichael(3, small_X, small_bound, false);
+      small->tabulate_car_interval(e.start, e.stop, 0, 1, output_file, true);
+    }else if(e.kind == "prefix"){
+      if(large == nullptr) large = new LargePreproduct(large_bound, large_X);
+      large->prefix_ranges.clear();
+      large->prefix_ranges.push_back(pair<long, long>(e.start, e.stop));
+      large->cars_threaded(e.key, output_file, 0, 1);
+    }else if(e.kind == "p1"){
+      if(large == nullptr) large = new LargePreproduct(large_bound, large_X);
+      large->cars4_threaded(output_file, e.start, e.stop);
+    }else{
+      // exit rather than report the unit done, so the coordinator gives it up and the run does not complete
+      cout << "Error in tab_parallel, unknown unit kind " << e.kind << "\n";
+      exit(1);
+    }
+  };
+
+  auto start = high_resolution_clock::now();
+
+  Coordinator coordinator = Coordinator(manifest_file, work_dir, num_workers, run_unit);
+  if(argc == 5) coordinator.lease_seconds = atof(argv[4]);
+  coordinator.pin_workers = pin_workers;
+  bool all_done = coordinator.run();
+
+  auto end = high_resolution_clock::now();
+  cout << "tab_parallel on " << coordinator.node_name << " finished in " << duration_cast<seconds>(end - start).count();
+  cout << " seconds, " << (all_done ? "all units complete" : "some units not complete") << "\n";
+  return all_done ? 0 : 1;
+}
@@ -13,6 +13,7 @@
 #include "Odometer.h"
 #include "bigint.h"
 #include "Pinch.h"
+#include "Manifest.h"
 #include <chrono>
 
 using namespace std::chrono;
@@ -26,7 +27,9 @@ using namespace std::chrono;
  * timing code from geeksforgeeks.org
  */
 
-// expecting no arguments
+// expecting no arguments, or job number and total jobs, or "manifest <file> <job>".
+// With a manifest, the job does the prefix ranges listed for it (see Manifest.h and plan.cpp).
+// Or "steal <num_threads>": one job does everything, its threads sharing the prefix trees by work stealing.
 int main(int argc, char* argv[]) {
   std::cout << "This is tab_serial, a program that tabulates Carmichaels on a single processor\n";
 
@@ -36,7 +39,25 @@ int main(int argc, char* argv[]) {
     int total_jobs;
     int job_num;
     string filename;
-    if(argc >= 2){
+    Manifest M;
+    bool by_manifest = false;
+    bool by_stealing = false;
+    long num_threads = 1;
+    if(argc == 4 && string(argv[1]) == "manifest"){
+        by_manifest = M.read(argv[2]);
+        job_num = atoi(argv[3]);
+        total_jobs = M.num_tasks();
+        std::cout << "job " << job_num << " of manifest " << argv[2] << " with " << total_jobs << " jobs\n";
+        filename = "cars6large.txt";
+        if(!by_manifest) return 1;
+    }else if(argc == 3 && string(argv[1]) == "steal"){
+        by_stealing = true;
+        num_threads = atol(argv[2]);
+        job_num = 0;
+        total_jobs = 1;
+        std::cout << "one job with " << num_threads << " work-stealing threads\n";
+        filename = "cars6large.txt";
+    }else if(argc >= 2){
         job_num = atoi(argv[1]);
         total_jobs = atoi(argv[2]);
         std::cout << "job " << job_num  << " of a total of " << total_jobs << "\n";
@@ -195,16 +216,24 @@ int main(int argc, char* argv[]) {
   
 
     
-    C4.cars4_threaded(cars_large4, job_num, total_jobs);
-    C4.cars5_threaded(cars_large5, job_num, total_jobs);
-    C4.cars6_threaded(cars_large6, job_num, total_jobs);
-    C4.cars7_threaded(cars_large7, job_num, total_jobs);
-    C4.cars8_threaded(cars_large8, job_num, total_jobs);
-    C4.cars9_threaded(cars_large9, job_num, total_jobs);
-    C4.cars_rec_threaded(10, cars_recursive10, job_num, total_jobs);
-    C4.cars_rec_threaded(11, cars_recursive11, job_num, total_jobs);
-    C4.cars_rec_threaded(12, cars_recursive12, job_num, total_jobs);
-    C4.cars_rec_threaded(13, cars_recursive13, job_num, total_jobs);
+    string large_files[14] = {"", "", "", "", cars_large4, cars_large5, cars_large6, cars_large7, cars_large8, 
+                              cars_large9, cars_recursive10, cars_recursive11, cars_recursive12, cars_recursive13};
+    for(long d = 4; d <= 13; ++d){
+      // with a manifest, this job owns the prefix ranges listed for it.  d without entries split by residue.
+      C4.prefix_ranges.clear();
+      if(by_manifest){
+        vector<ManifestEntry> pieces = M.for_task(job_num, "prefix", d);
+        for(long k = 0; k < pieces.size(); ++k){
+          C4.prefix_ranges.push_back(pair<long, long>(pieces[k].start, pieces[k].stop));
+        }
+      }
+      // d = 4 splits by p1, as given by this job's p1 entry if the manifest has one
+      vector<ManifestEntry> p1_pieces;
+      if(by_manifest && d == 4) p1_pieces = M.for_task(job_num, "p1", 4);
+      if(by_stealing) C4.cars_stealing(d, large_files[d], num_threads);
+      else if(p1_pieces.size() > 0) C4.cars4_threaded(large_files[d], p1_pieces[0].start, p1_pieces[0].stop);
+      else C4.cars_threaded(d, large_files[d], job_num, total_jobs);
+    }
     
 
     /*
@@ -21,6 +21,12 @@ cd ~ashallue/tabulate_car
 # run command
 #LD_LIBRARY_PATH=/share/apps/lib64 ./tabulate ${SGE_TASK_ID} 1000000
 
+# balanced version: plan once with e.g. ./plan large 1000000000000000000 1000000 32 manifest.txt 4 13
+# then each task does its own entries.  SGE task ids start at 1, manifest tasks at 0.
+# Planning times every 1024th prefix (the default stride), so it costs about 1/1024 of the whole large 
+# tabulation on one core, i.e. about 1/32 of one task's share here.  A stride of s costs 1/s.
+#LD_LIBRARY_PATH=/share/apps/lib64 ./tab_serial manifest manifest.txt $((SGE_TASK_ID - 1))
+
 LD_LIBRARY_PATH=/share/apps/lib64 ./tab_serial
 
 #LD_LIBRARY_PATH=/share/apps/lib64 ./tabulate 4 1000000
@@ -18,5 +18,5 @@
 # change directory
 cd ~ashallue/tabulate_car
 
-# run command
+# run command.  Task i times the two pre-product sources with pre-products up to 10^4 i
 LD_LIBRARY_PATH=/share/apps/lib64 ./timings ${SGE_TASK_ID}
@@ -7,7 +7,6 @@
 #include "Factgen.h"
 #include "Construct_car.h"
 #include "SmallP_Carmichael.h"
-#include "LargeP_Carmichael.h"
 #include "Odometer.h"
 #include "bigint.h"
 #include "Pinch.h"
@@ -52,6 +51,26 @@ int main(int argc, char* argv[]) {
   } 
   */
 
+  // Comparison of the two pre-product sources (see PreproductSource.h) with pre-products up to bound: 
+  // the incremental sieve and the backtracking search.  Both write the same Carmichaels.
+  cout << "Timings for pre-product sources with pre-products up to " << bound << "\n";
+  SmallP_Carmichael S1 = SmallP_Carmichael(3, bound, 0, false);
+
+  SievePreproducts sieve_source;
+  sieve_source.init(3, bound);
+  auto start_sieve = high_resolution_clock::now();
+  S1.tabulate_car_source(sieve_source, 0, 1, "cars_sieve.txt", false);
+  auto end_sieve = high_resolution_clock::now();
+  auto duration_sieve = duration_cast<milliseconds>(end_sieve - start_sieve);
+  cout << "Timing for SievePreproducts in milliseconds: " << duration_sieve.count() << "\n";
+
+  BacktrackPreproducts backtrack_source;
+  backtrack_source.init(3, bound);
+  auto start_backtrack = high_resolution_clock::now();
+  S1.tabulate_car_source(backtrack_source, 0, 1, "cars_backtrack.txt", false);
+  auto end_backtrack = high_resolution_clock::now();
+  auto duration_backtrack = duration_cast<milliseconds>(end_backtrack - start_backtrack);
+  cout << "Timing for BacktrackPreproducts in milliseconds: " << duration_backtrack.count() << "\n";
   
   // timing code from geeksforgeeks.org
   // Comparison of three methods: D-Delta, CD, and crossover